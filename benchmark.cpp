@@ -0,0 +1,511 @@
+//  benchmark.cpp
+//  Checks the SIMD kernels against the scalar intersection functions and the sample dimensions against each other, then renders the canonical scenes at several sizes
+//  and thread counts and checks the images against the golden images
+//  Created by 電波
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cctype>
+#include "common.hpp"
+#include "tuple.hpp"
+#include "matrix.hpp"
+#include "sampling.hpp"
+#include "cpu.hpp"
+#include "tracer.hpp"
+#include "miscellaneous.hpp"
+#include "memory.hpp"
+#include "texture.hpp"
+#include "culling.hpp"
+#include "renderer.hpp"
+#include "denoiser.hpp"
+#include "scene.hpp"
+#include "debug.hpp"
+
+// -----------------------------------------------
+// @denpa: The canonical scenes and resolutions. Every combination is rendered with 1, 2, 4, ... threads up to the hardware thread count.
+// -----------------------------------------------
+GLOBAL_VARIABLE const u64 benchmarkSphereCounts[] = {1, 1000, 100000, 1000000};
+GLOBAL_VARIABLE const u32 benchmarkResolutions[] = {128, 256, 512};
+
+#define BENCHMARK_SAMPLES_PER_PIXEL 4
+
+// -----------------------------------------------
+// @denpa: Camera rays only test the spheres binned into their tile. A tile covering part of the grid gets its share of the
+// spheres, and the grid is covered by as many camera rays as it has pixels, so all the camera rays together make about
+// sphereCount * tileSize^2 ray-sphere tests per sample whatever the resolution is. Shadow rays aren't culled and test
+// every sphere, and they leave the pixels that hit a sphere, which are about the coverage of the image.
+// By default, combinations that need more ray-sphere tests than this are skipped, which leaves out the largest grids,
+// and the run ends with how many were skipped. --work-limit sets another limit, and --full runs every combination.
+// -----------------------------------------------
+#define BENCHMARK_GRID_COVERAGE 0.4
+#define BENCHMARK_DEFAULT_WORK_LIMIT 4e9
+
+// -----------------------------------------------
+// @denpa: A pixel differs from the golden image when any channel is off by more than the channel tolerance.
+// The image passes when the fraction of differing pixels stays under the pixel tolerance.
+// A missing golden image is a failure too, unless --update-golden is passed to write it.
+// The golden images are rendered with the canonical samples per pixel, so with any other --samples they are neither
+// compared nor written.
+// Some difference is expected, since the math library and floating point contraction change between compilers.
+// -----------------------------------------------
+#define GOLDEN_DIRECTORY "golden"
+#define GOLDEN_CHANNEL_TOLERANCE 8.f
+#define GOLDEN_PIXEL_TOLERANCE 0.001
+
+// -----------------------------------------------
+// @denpa: Every kernel is compared with the scalar find*RayIntersections() functions on random rays,
+// for each shape type and every instruction set the CPU supports. The shape count isn't a multiple of any lane count,
+// so the padding at the end of the sets gets tested too. The t values may differ by the relative tolerance,
+// since the kernels transform the ray with the same math but the compiler is free to order it differently.
+// -----------------------------------------------
+#define KERNEL_CHECK_SHAPE_COUNT 37
+#define KERNEL_CHECK_RAY_COUNT 8192
+#define KERNEL_CHECK_SEED 0x4b45524eu
+#define KERNEL_CHECK_TOLERANCE 1e-3f
+
+GLOBAL_VARIABLE const char* shapeTypeNames[SHAPE_TYPE_COUNT] = {"sphere", "plane", "box", "cylinder", "cone"};
+
+// -----------------------------------------------
+// @denpa: The samples a pixel takes in two different dimensions have to be independent. For every pixel, the differences
+// between the two dimensions are put on a circle, and the squared length of their mean is 1 when one dimension
+// is a shifted copy of the other, while independent dimensions give 1 / sample count on average.
+// The check fails when the average over the pixels is more than the tolerance times that.
+// -----------------------------------------------
+#define SAMPLING_CHECK_PIXEL_COUNT 4096
+#define SAMPLING_CHECK_SAMPLE_COUNT 16
+#define SAMPLING_CHECK_LIGHT_COUNT 2
+#define SAMPLING_CHECK_SEED 0x53414d50u
+#define SAMPLING_CHECK_TOLERANCE 2.0
+
+// -----------------------------------------------
+// @denpa: Everything that can be changed from the command line. A value of 0 means every value is benchmarked.
+// -----------------------------------------------
+typedef struct benchmarkOptions {
+	u64 sphereCount = 0;
+	u32 resolution = 0;
+	u32 threadCount = 0;
+	u32 samplesPerPixel = BENCHMARK_SAMPLES_PER_PIXEL;
+	f64 workLimit = BENCHMARK_DEFAULT_WORK_LIMIT;
+	bool full = false;
+	bool updateGolden = false;
+	const char* instructionSet = NULL;
+} benchmarkOptions;
+
+// -----------------------------------------------
+// @denpa: The result of comparing an image with its golden image.
+// -----------------------------------------------
+typedef struct goldenComparison {
+	bool found = false;
+	bool passed = false;
+	u64 differingPixels = 0;
+	f32 maximumDifference = 0.f;
+} goldenComparison;
+
+// -----------------------------------------------
+// @denpa: Parses the command line arguments into the benchmark options.
+// -----------------------------------------------
+INTERNAL DNOINLINE benchmarkOptions parseBenchmarkOptions(int argc, const char** argv) {
+	benchmarkOptions options = {};
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = (i + 1) < argc;
+		if (hasValue && strcmp(argv[i], "--spheres") == 0) {
+			options.sphereCount = strtoull(argv[++i], NULL, 10);
+		} else if (hasValue && strcmp(argv[i], "--resolution") == 0) {
+			options.resolution = (u32)atoi(argv[++i]);
+		} else if (hasValue && strcmp(argv[i], "--threads") == 0) {
+			options.threadCount = (u32)atoi(argv[++i]);
+		} else if (hasValue && strcmp(argv[i], "--samples") == 0) {
+			u32 samplesPerPixel = (u32)atoi(argv[++i]);
+			options.samplesPerPixel = DENPA_MAX(samplesPerPixel, 1u);
+		} else if (hasValue && strcmp(argv[i], "--work-limit") == 0) {
+			options.workLimit = strtod(argv[++i], NULL);
+		} else if (hasValue && strcmp(argv[i], "--isa") == 0) {
+			options.instructionSet = argv[++i];
+		} else if (strcmp(argv[i], "--full") == 0) {
+			options.full = true;
+		} else if (strcmp(argv[i], "--update-golden") == 0) {
+			options.updateGolden = true;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+		}
+	}
+	return options;
+}
+
+// -----------------------------------------------
+// @denpa: Reads a .ppm file written by createPPMFile() or createBinaryPPMFile() into the arena.
+// The colours are returned in the range [0, 255]. Returns NULL on failure, or when the image doesn't fit in the arena.
+// -----------------------------------------------
+INTERNAL DNOINLINE colour* readPPMFile(memoryArena* arena, const char* fileName, u32* x, u32* y) {
+	FILE* input = fopen(fileName, "rb");
+	if (!input) {return NULL;}
+
+	char format[3] = {};
+	u32 maximum = 0;
+	if (fscanf(input, "%2s %u %u %u", format, x, y, &maximum) != 4 || maximum != 255 ||
+		(strcmp(format, "P3") != 0 && strcmp(format, "P6") != 0)) {
+		fclose(input);
+		return NULL;
+	}
+	fgetc(input);
+
+	u64 pixelsSize = sizeof(colour) * (u64)(*x) * (*y);
+	if (arena->used + pixelsSize + ARENA_DEFAULT_ALIGNMENT > arena->size) {
+		fclose(input);
+		return NULL;
+	}
+
+	bool binary = format[1] == '6';
+	colour* pixels = PUSH_ARRAY(arena, colour, (u64)(*x) * (*y));
+	for (u32 i = 0; i < (*x) * (*y); i++) {
+		int rgb[3] = {};
+		if (binary) {
+			u8 bytes[3] = {};
+			if (fread(bytes, sizeof(bytes), 1, input) != 1) {fclose(input); return NULL;}
+			for (u32 j = 0; j < 3; j++) {rgb[j] = bytes[j];}
+		} else if (fscanf(input, "%d %d %d", &rgb[0], &rgb[1], &rgb[2]) != 3) {
+			fclose(input);
+			return NULL;
+		}
+		pixels[i] = createColour((f32)rgb[0], (f32)rgb[1], (f32)rgb[2], 255.f);
+	}
+	fclose(input);
+	return pixels;
+}
+
+// -----------------------------------------------
+// @denpa: Compares the scaled colours of the frame buffer with the golden image.
+// The golden image is read into its own arena, so that it doesn't count towards the peak memory of the renderer.
+// -----------------------------------------------
+INTERNAL DNOINLINE goldenComparison compareWithGolden(const char* fileName, frameBuffer* buffer) {
+	goldenComparison result = {};
+	u32 goldenX = 0;
+	u32 goldenY = 0;
+	memoryArena arena = createArena("golden", (sizeof(colour) * buffer->width * buffer->height) + ARENA_DEFAULT_ALIGNMENT, false);
+	colour* golden = readPPMFile(&arena, fileName, &goldenX, &goldenY);
+	if (!golden) {
+		destroyArena(&arena);
+		return result;
+	}
+
+	result.found = true;
+	if (goldenX != buffer->width || goldenY != buffer->height) {
+		destroyArena(&arena);
+		return result;
+	}
+
+	u64 pixelCount = (u64)goldenX * goldenY;
+	for (u64 i = 0; i < pixelCount; i++) {
+		// @denpa: The golden image was written with the same truncation as createPPMFile().
+		f32 difference = DENPA_MAX(DENPA_MAX(fabsf(golden[i].r - floorf(buffer->pixels[i].r)), fabsf(golden[i].g - floorf(buffer->pixels[i].g))),
+								   fabsf(golden[i].b - floorf(buffer->pixels[i].b)));
+		result.maximumDifference = DENPA_MAX(result.maximumDifference, difference);
+		result.differingPixels += (difference > GOLDEN_CHANNEL_TOLERANCE);
+	}
+	result.passed = (f64)result.differingPixels <= (GOLDEN_PIXEL_TOLERANCE * (f64)pixelCount);
+	destroyArena(&arena);
+	return result;
+}
+
+// -----------------------------------------------
+// @denpa: Returns a random value in [minimum, maximum) for the given shape or ray and dimension.
+// -----------------------------------------------
+INTERNAL DINLINE f32 randomKernelCheckValue(u32 index, u32 dimension, f32 minimum, f32 maximum) {
+	return minimum + ((maximum - minimum) * randomF32(index, 0, dimension, KERNEL_CHECK_SEED));
+}
+
+// -----------------------------------------------
+// @denpa: A random placement for a shape. Axis aligned shapes are only scaled and moved, so their caps stay horizontal.
+// -----------------------------------------------
+INTERNAL DNOINLINE matrix4x4 createKernelCheckTransformation(u32 index, bool axisAligned) {
+	matrix4x4 transformation = multiplyMatrices4x4(createTranslationMatrix(randomKernelCheckValue(index, 0, -3.f, 3.f), randomKernelCheckValue(index, 1, -3.f, 3.f),
+																		   randomKernelCheckValue(index, 2, -3.f, 3.f)),
+												   createScaleMatrix(randomKernelCheckValue(index, 3, .3f, 1.5f), randomKernelCheckValue(index, 4, .3f, 1.5f),
+																	 randomKernelCheckValue(index, 5, .3f, 1.5f)));
+	if (axisAligned) {return transformation;}
+	matrix4x4 rotation = multiplyMatrices4x4(createRotationMatrixZAxis(randomKernelCheckValue(index, 6, 0.f, 2.f * (f32)PI32)),
+											 multiplyMatrices4x4(createRotationMatrixYAxis(randomKernelCheckValue(index, 7, 0.f, 2.f * (f32)PI32)),
+																 createRotationMatrixXAxis(randomKernelCheckValue(index, 8, 0.f, 2.f * (f32)PI32))));
+	return multiplyMatrices4x4(transformation, rotation);
+}
+
+// -----------------------------------------------
+// @denpa: Fills a world with KERNEL_CHECK_SHAPE_COUNT shapes of every type at random places.
+// Every other cylinder and cone is closed, and every fourth open one is infinite.
+// -----------------------------------------------
+INTERNAL DNOINLINE world createKernelCheckWorld(memoryArena* arena, bool axisAligned) {
+	u64 count = KERNEL_CHECK_SHAPE_COUNT;
+	world world = {.sphereCount = count, .planeCount = count, .boxCount = count, .cylinderCount = count, .coneCount = count};
+	world.spheres = PUSH_ARRAY(arena, sphere, count);
+	world.planes = PUSH_ARRAY(arena, plane, count);
+	world.boxes = PUSH_ARRAY(arena, box, count);
+	world.cylinders = PUSH_ARRAY(arena, cylinder, count);
+	world.cones = PUSH_ARRAY(arena, cone, count);
+	for (u32 i = 0; i < count; i++) {
+		u32 index = i * SHAPE_TYPE_COUNT;
+		world.spheres[i] = createSphere();
+		setSphereTransformation(&world, &world.spheres[i], createKernelCheckTransformation(index + SHAPE_SPHERE, axisAligned));
+
+		world.planes[i] = {};
+		setShapeTransformation(&world, &world.planes[i], createKernelCheckTransformation(index + SHAPE_PLANE, axisAligned));
+
+		world.boxes[i] = {.minimum = createPoint(randomKernelCheckValue(index, 9, -1.f, 0.f), randomKernelCheckValue(index, 10, -1.f, 0.f), randomKernelCheckValue(index, 11, -1.f, 0.f)),
+						  .maximum = createPoint(randomKernelCheckValue(index, 12, 0.f, 1.f), randomKernelCheckValue(index, 13, 0.f, 1.f), randomKernelCheckValue(index, 14, 0.f, 1.f))};
+		setShapeTransformation(&world, &world.boxes[i], createKernelCheckTransformation(index + SHAPE_BOX, axisAligned));
+
+		bool closed = (i % 2) == 0;
+		bool infinite = (i % 4) == 1;
+		world.cylinders[i] = {.minimum = infinite ? -INFINITY : randomKernelCheckValue(index, 15, -2.f, 0.f),
+							  .maximum = infinite ? INFINITY : randomKernelCheckValue(index, 16, 0.f, 2.f), .closed = closed};
+		setShapeTransformation(&world, &world.cylinders[i], createKernelCheckTransformation(index + SHAPE_CYLINDER, axisAligned));
+
+		// @denpa: Some cones keep both caps on one side of the tip, the others are cut off around it.
+		f32 coneMinimum = randomKernelCheckValue(index, 17, -2.f, (i % 3) ? 0.f : 1.f);
+		world.cones[i] = {.minimum = infinite ? -INFINITY : coneMinimum,
+						  .maximum = infinite ? INFINITY : DENPA_MAX(coneMinimum, 0.f) + randomKernelCheckValue(index, 18, .1f, 2.f), .closed = closed};
+		setShapeTransformation(&world, &world.cones[i], createKernelCheckTransformation(index + SHAPE_CONE, axisAligned));
+	}
+	createShapeSets(arena, &world);
+	return world;
+}
+
+// -----------------------------------------------
+// @denpa: A random ray from around the shapes towards a random point among them.
+// For the axis aligned shapes every fourth ray is horizontal, so it runs parallel to the caps and to the planes,
+// and every fourth ray is vertical, so it runs parallel to the sides of the cylinders and hits their caps straight on.
+// Every fourth ray grazes a cap of a closed cylinder or cone instead: it crosses the plane of the cap inside the cap,
+// but so close to parallel that the scalar functions don't count the cap, and neither may the kernels.
+// -----------------------------------------------
+INTERNAL DNOINLINE ray createKernelCheckRay(world* world, u32 index, bool axisAligned) {
+	point origin = createPoint(randomKernelCheckValue(index, 0, -5.f, 5.f), randomKernelCheckValue(index, 1, -5.f, 5.f), randomKernelCheckValue(index, 2, -5.f, 5.f));
+	point target = createPoint(randomKernelCheckValue(index, 3, -3.f, 3.f), randomKernelCheckValue(index, 4, -3.f, 3.f), randomKernelCheckValue(index, 5, -3.f, 3.f));
+	if (axisAligned && (index % 4) == 1) {target.y = origin.y;}
+	if (axisAligned && (index % 4) == 2) {
+		target.x = origin.x;
+		target.z = origin.z;
+	}
+	if (axisAligned && (index % 4) == 3) {
+		// @denpa: Only the even shapes are closed and finite. The object space slope stays under EPSILON since no shape is scaled below .3.
+		u32 shape = 2 * ((index / 4) % (KERNEL_CHECK_SHAPE_COUNT / 2));
+		bool isCone = ((index / 4) % 2) == 1;
+		bool isTop = ((index / 8) % 2) == 1;
+		f32 capY = isCone ? (isTop ? world->cones[shape].maximum : world->cones[shape].minimum) :
+							(isTop ? world->cylinders[shape].maximum : world->cylinders[shape].minimum);
+		f32 capRadius = isCone ? fabsf(capY) : 1.f;
+		matrix4x4 transformation = isCone ? world->cones[shape].transformation : world->cylinders[shape].transformation;
+		target = multiplyMatrix4x4Tuple(transformation, createPoint(randomKernelCheckValue(index, 6, -.7f, .7f) * capRadius, capY, 0.f));
+		f32 angle = randomKernelCheckValue(index, 7, 0.f, 2.f * (f32)PI32);
+		vector direction = createVector(cosf(angle), (isTop ? -.25f : .25f) * EPSILON, sinf(angle));
+		return ray {subtractTuples(target, scaleTuple(direction, randomKernelCheckValue(index, 8, 1.f, 4.f))), direction};
+	}
+	return ray {origin, normalizeTuple(subtractTuples(target, origin))};
+}
+
+// -----------------------------------------------
+// @denpa: Checks if two t values are the same within the relative tolerance.
+// -----------------------------------------------
+INTERNAL DINLINE bool areKernelCheckValuesEqual(f32 a, f32 b) {
+	return fabsf(a - b) <= KERNEL_CHECK_TOLERANCE * DENPA_MAX(1.f, DENPA_MAX(fabsf(a), fabsf(b)));
+}
+
+// -----------------------------------------------
+// @denpa: Compares the kernels of one instruction set with the scalar functions on the shapes of the world.
+// The scalar results come from findClosestShape() on a copy of the world with dirty shape sets, which is the same
+// fallback the tracer uses. Both the closest hit and the any hit kernels are checked. Returns the number of mismatches.
+// -----------------------------------------------
+INTERNAL DNOINLINE u64 checkKernelsOnWorld(cpuKernels* candidate, world* world, bool axisAligned) {
+	struct world scalarWorld = *world;
+	scalarWorld.shapeSetsDirty = true;
+	u64 mismatches = 0;
+	for (u32 i = 0; i < KERNEL_CHECK_RAY_COUNT; i++) {
+		ray ray = createKernelCheckRay(world, i, axisAligned);
+		f32 maximumT = randomKernelCheckValue(i, 6, 0.f, 12.f);
+		for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+			f32 scalarT = 0.f;
+			f32 kernelT = 0.f;
+			u64 scalarIndex = findClosestShape(&scalarWorld, (shapeType)type, ray, INFINITY, &scalarT);
+			u64 kernelIndex = candidate->findClosestShape[type](&world->shapeSets[type], ray.rayOrigin, ray.rayDirection, INFINITY, &kernelT);
+			// @denpa: Two shapes hit at the same t can be picked in either order.
+			bool bothMissed = scalarIndex == SHAPE_SET_MISS && kernelIndex == SHAPE_SET_MISS;
+			bool bothHit = scalarIndex != SHAPE_SET_MISS && kernelIndex != SHAPE_SET_MISS;
+			bool closestMatches = bothMissed || (bothHit && areKernelCheckValuesEqual(scalarT, kernelT));
+
+			bool scalarAnyHit = scalarIndex != SHAPE_SET_MISS && scalarT < maximumT;
+			bool kernelAnyHit = candidate->isAnyShapeHit[type](&world->shapeSets[type], ray.rayOrigin, ray.rayDirection, maximumT);
+			bool anyHitMatches = (scalarAnyHit == kernelAnyHit) || (scalarIndex != SHAPE_SET_MISS && areKernelCheckValuesEqual(scalarT, maximumT));
+
+			if (closestMatches && anyHitMatches) {continue;}
+			if (mismatches < 4) {
+				printf("  %s kernel mismatch on ray %u (%s): scalar hit %lld at %f, kernel hit %lld at %f, any hit below %f: scalar %d, kernel %d\n",
+					   shapeTypeNames[type], i, axisAligned ? "axis aligned" : "rotated", (long long)scalarIndex, (f64)scalarT,
+					   (long long)kernelIndex, (f64)kernelT, (f64)maximumT, scalarAnyHit, kernelAnyHit);
+			}
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+// -----------------------------------------------
+// @denpa: Checks the kernels of every instruction set the CPU supports, and returns false if any of them is wrong.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool checkKernels(void) {
+	u64 count = KERNEL_CHECK_SHAPE_COUNT;
+	memoryArena arena = createArena("kernel check", 2 * sceneMemorySize(count, count, count, count, count, 0), false);
+	world worlds[2] = {createKernelCheckWorld(&arena, false), createKernelCheckWorld(&arena, true)};
+
+	instructionSet supported = detectInstructionSet();
+	u32 first = (supported == INSTRUCTION_SET_GENERIC) ? INSTRUCTION_SET_GENERIC : INSTRUCTION_SET_SSE2;
+	bool passed = true;
+	for (u32 set = first; set <= supported; set++) {
+		cpuKernels candidate = getInstructionSetKernels((instructionSet)set);
+		u64 mismatches = checkKernelsOnWorld(&candidate, &worlds[0], false) + checkKernelsOnWorld(&candidate, &worlds[1], true);
+		printf("Checked the %s kernels on %u rays against %u shapes of every type: %s (%llu mismatches)\n", instructionSetNames[set],
+			   2 * KERNEL_CHECK_RAY_COUNT, KERNEL_CHECK_SHAPE_COUNT, mismatches ? "BROKEN" : "ok", (unsigned long long)mismatches);
+		passed = passed && (mismatches == 0);
+	}
+	destroyArena(&arena);
+	return passed;
+}
+
+// -----------------------------------------------
+// @denpa: The average over the pixels of the squared length of the mean difference between two sample dimensions,
+// on the u axis when useV is false and on the v axis otherwise.
+// -----------------------------------------------
+INTERNAL DNOINLINE f64 measureDimensionCorrelation(u32 dimensionA, u32 dimensionB, bool useV) {
+	f64 sum = 0.0;
+	for (u32 pixelIndex = 0; pixelIndex < SAMPLING_CHECK_PIXEL_COUNT; pixelIndex++) {
+		f64 cosineSum = 0.0;
+		f64 sineSum = 0.0;
+		for (u32 sampleIndex = 0; sampleIndex < SAMPLING_CHECK_SAMPLE_COUNT; sampleIndex++) {
+			sample2D a = lowDiscrepancySample2D(pixelIndex, sampleIndex, dimensionA, SAMPLING_CHECK_SEED);
+			sample2D b = lowDiscrepancySample2D(pixelIndex, sampleIndex, dimensionB, SAMPLING_CHECK_SEED);
+			f64 angle = 2.0 * PI32 * (useV ? (f64)(a.v - b.v) : (f64)(a.u - b.u));
+			cosineSum += cos(angle);
+			sineSum += sin(angle);
+		}
+		sum += ((cosineSum * cosineSum) + (sineSum * sineSum)) / (SAMPLING_CHECK_SAMPLE_COUNT * SAMPLING_CHECK_SAMPLE_COUNT);
+	}
+	return sum / SAMPLING_CHECK_PIXEL_COUNT;
+}
+
+// -----------------------------------------------
+// @denpa: Checks every pair of the pixel and light dimensions for independence, and returns false if any pair is correlated.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool checkSampling(void) {
+	u32 dimensions[SAMPLING_CHECK_LIGHT_COUNT + 1] = {SAMPLE_DIMENSION_PIXEL};
+	for (u32 i = 0; i < SAMPLING_CHECK_LIGHT_COUNT; i++) {dimensions[i + 1] = SAMPLE_DIMENSION_LIGHT + (i * 2);}
+
+	f64 limit = SAMPLING_CHECK_TOLERANCE / SAMPLING_CHECK_SAMPLE_COUNT;
+	f64 worst = 0.0;
+	for (u32 a = 0; a < DENPA_ARRAY_SIZE(dimensions); a++) {
+		for (u32 b = a + 1; b < DENPA_ARRAY_SIZE(dimensions); b++) {
+			worst = DENPA_MAX(worst, measureDimensionCorrelation(dimensions[a], dimensions[b], false));
+			worst = DENPA_MAX(worst, measureDimensionCorrelation(dimensions[a], dimensions[b], true));
+		}
+	}
+	printf("Checked the sample dimensions for independence on %u pixels: %s (correlation %.4f, limit %.4f)\n", SAMPLING_CHECK_PIXEL_COUNT,
+		   (worst <= limit) ? "ok" : "BROKEN", worst, limit);
+	return worst <= limit;
+}
+
+// -----------------------------------------------
+// @denpa: Renders one scene at one resolution with every thread count, and returns false if any image is broken.
+// A scene over the work limit isn't rendered, and skipped is set instead.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool benchmarkScene(benchmarkOptions* options, u64 sphereCount, u32 resolution, bool* skipped) {
+	u64 lightCount = 1;
+	renderSettings settings = {.canvasX = resolution, .canvasY = resolution, .samplesPerPixel = options->samplesPerPixel};
+	f64 pixelCount = (f64)resolution * resolution;
+	f64 work = (f64)options->samplesPerPixel * (pixelCount + ((f64)sphereCount * settings.tileSize * settings.tileSize) +
+												(BENCHMARK_GRID_COVERAGE * pixelCount * (f64)sphereCount));
+	*skipped = !options->full && work > options->workLimit;
+	if (*skipped) {
+		printf("%10llu %6u %8s   skipped, needs %.1e ray-sphere tests, over the work limit of %.1e (use --full)\n", (unsigned long long)sphereCount,
+			   resolution, "-", work, options->workLimit);
+		return true;
+	}
+
+	camera camera = {};
+	u64 frameMemorySize = frameBufferMemorySize(resolution, resolution) + sceneMemorySize(sphereCount, 0, 0, 0, 0, lightCount);
+	memory.frame = createArena("frame", frameMemorySize, true);
+	frameBuffer buffer = createFrameBuffer(&memory.frame, resolution, resolution);
+	world world = createSphereGridScene(&memory.frame, sphereCount);
+
+	char goldenFileName[256] = {};
+	snprintf(goldenFileName, sizeof(goldenFileName), GOLDEN_DIRECTORY "/spheres_%llu_%u.ppm", (unsigned long long)sphereCount, resolution);
+
+	u32 maximumThreadCount = resolveThreadCount(options->threadCount);
+	u32 threadCount = options->threadCount ? maximumThreadCount : 1;
+	bool passed = true;
+	for (;;) {
+		settings.threadCount = threadCount;
+		resetMemoryStatistics();
+
+		auto start = std::chrono::steady_clock::now();
+		renderStatistics statistics = renderImage(&world, &camera, &settings, &buffer, &memory.frame);
+		f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+		f64 raysPerSecond = (f64)(statistics.cameraRays + statistics.shadowRays) / seconds;
+
+		const char* status = "updated";
+		goldenComparison comparison = {};
+		if (options->samplesPerPixel != BENCHMARK_SAMPLES_PER_PIXEL) {
+			status = "skipped, not the canonical samples per pixel";
+		} else if (options->updateGolden) {
+			createBinaryPPMFile(goldenFileName, resolution, resolution, buffer.pixels);
+		} else {
+			comparison = compareWithGolden(goldenFileName, &buffer);
+			status = comparison.found ? (comparison.passed ? "ok" : "BROKEN") : "MISSING golden";
+			passed = passed && comparison.passed;
+		}
+
+		printf("%10llu %6u %8u %12.2f %12.3f %10.2f   %s", (unsigned long long)sphereCount, resolution, threadCount,
+			   seconds * 1000.0, raysPerSecond / 1e6, (f64)totalPeakMemory() / (f64)DENPA_MEGABYTES(1), status);
+		if (comparison.found) {printf(" (%llu pixels differ, max %.0f)", (unsigned long long)comparison.differingPixels, (f64)comparison.maximumDifference);}
+		printf("\n");
+
+		if (threadCount >= maximumThreadCount) {break;}
+		threadCount = DENPA_MIN(threadCount * 2, maximumThreadCount);
+	}
+
+	destroyArena(&memory.frame);
+	return passed;
+}
+
+// -----------------------------------------------
+// @denpa: Runs every benchmark, the exit code is EXIT_FAILURE if any image didn't match its golden image or had none.
+// -----------------------------------------------
+int main(int argc, const char** argv) {
+	benchmarkOptions options = parseBenchmarkOptions(argc, argv);
+	selectKernels(options.instructionSet);
+	bool passed = checkKernels();
+	passed = checkSampling() && passed;
+
+	printf("%10s %6s %8s %12s %12s %10s   %s\n", "spheres", "size", "threads", "time (ms)", "Mrays/s", "peak (MB)", "golden");
+	u32 sceneCount = 0;
+	u32 skippedCount = 0;
+	for (u32 i = 0; i < DENPA_ARRAY_SIZE(benchmarkSphereCounts); i++) {
+		if (options.sphereCount && options.sphereCount != benchmarkSphereCounts[i]) {continue;}
+		for (u32 j = 0; j < DENPA_ARRAY_SIZE(benchmarkResolutions); j++) {
+			if (options.resolution && options.resolution != benchmarkResolutions[j]) {continue;}
+			bool skipped = false;
+			passed = benchmarkScene(&options, benchmarkSphereCounts[i], benchmarkResolutions[j], &skipped) && passed;
+			sceneCount++;
+			skippedCount += skipped;
+		}
+	}
+	if (skippedCount) {
+		printf("Skipped %u of %u scenes over the work limit of %.1e ray-sphere tests, pass --full to run all of them\n", skippedCount, sceneCount,
+			   options.workLimit);
+	}
+
+	destroyMemorySystem();
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
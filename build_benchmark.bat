@@ -0,0 +1 @@
+@clang++ benchmark.cpp -o denpaRayBenchmark.exe -O3 -std=c++2b -Weverything -Wno-c99-extensions -Wno-c++98-compat-pedantic -Wno-old-style-cast -Wno-zero-as-null-pointer-constant -Wno-c11-extensions -Wno-gnu-anonymous-struct -ffp-contract=off -ftrivial-auto-var-init=unitialized
@@ -61,6 +61,14 @@ typedef double f64;
 #error "Unknown platform"
 #endif
 
+// -----------------------------------------------
+// @denpa: Detects if SSE2 is available. It is always available on x64.
+// -----------------------------------------------
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define DENPA_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
 // -----------------------------------------------
 // @denpa: Determines the appropriate keyword for assertion depending on the compiler used.
 // -----------------------------------------------
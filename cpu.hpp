@@ -0,0 +1,280 @@
+//  cpu.hpp
+//  Contains the CPU feature detection and the table of SIMD kernels picked at startup
+//  Created by 電波
+
+#pragma once
+
+#if DENPA_SIMD_SSE2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// -----------------------------------------------
+// @denpa: The instruction sets the kernels are compiled for, from the slowest to the fastest.
+// The generic kernels are only used when the target isn't x86.
+// Every variant does the same operations in the same order, so the image doesn't depend on the variant picked.
+// This only holds as long as the compiler doesn't fuse multiplies and adds, hence -ffp-contract=off in the build scripts.
+// -----------------------------------------------
+typedef enum instructionSet : u32 {
+	INSTRUCTION_SET_GENERIC = 0,
+	INSTRUCTION_SET_SSE2 = 1,
+	INSTRUCTION_SET_AVX2 = 2,
+	INSTRUCTION_SET_AVX512 = 3,
+} instructionSet;
+
+GLOBAL_VARIABLE const char* instructionSetNames[] = {"generic", "sse2", "avx2", "avx512"};
+
+// -----------------------------------------------
+// @denpa: The primitive types. Every type is intersected in batches by its own kernels.
+// -----------------------------------------------
+typedef enum shapeType : u32 {
+	SHAPE_SPHERE = 0,
+	SHAPE_PLANE = 1,
+	SHAPE_BOX = 2,
+	SHAPE_CYLINDER = 3,
+	SHAPE_CONE = 4,
+	SHAPE_TYPE_COUNT = 5,
+} shapeType;
+
+// -----------------------------------------------
+// @denpa: A copy of the shapes of one type in a layout the kernels can load KERNEL_LANES shapes at a time from.
+// The data holds arrays of paddedCount floats: first the top three rows of the inverse transformations (row-major),
+// then the parameters of the type. Spheres store their origin, boxes their minimum and maximum corners,
+// and cylinders and cones their minimum and maximum y and whether they are closed. Planes have no parameters.
+// The arrays are padded to a multiple of SHAPE_SET_PADDING so that the widest kernel never reads past the end.
+// -----------------------------------------------
+typedef struct shapeSet {
+	f32* data = NULL;
+	u64 count = 0;
+	u64 paddedCount = 0;
+} shapeSet;
+
+GLOBAL_VARIABLE const u32 shapeSetArrayCounts[SHAPE_TYPE_COUNT] = {15, 12, 18, 15, 15};
+
+#define SHAPE_SET_ORIGIN_X 12
+#define SHAPE_SET_ORIGIN_Y 13
+#define SHAPE_SET_ORIGIN_Z 14
+#define SHAPE_SET_MINIMUM_X 12
+#define SHAPE_SET_MAXIMUM_X 15
+#define SHAPE_SET_MINIMUM 12
+#define SHAPE_SET_MAXIMUM 13
+#define SHAPE_SET_CLOSED 14
+#define SHAPE_SET_PADDING 16
+#define SHAPE_SET_MISS 0xFFFFFFFFFFFFFFFFull
+
+// -----------------------------------------------
+// @denpa: Picks the hit findRayHits() would pick out of the two roots of a sphere, or returns 0.f if there is none.
+// When both roots are equal the ray only touches the sphere, so the far root doesn't count.
+// -----------------------------------------------
+INTERNAL DINLINE f32 firstPositiveSphereHit(f32 nearT, f32 farT, f32 discriminant) {
+	if (discriminant < 0.f) {return 0.f;}
+	if (nearT > 0.f) {return nearT;}
+	if (farT > 0.f && !areFloatsEqual(nearT, farT)) {return farT;}
+	return 0.f;
+}
+
+#if DENPA_SIMD_SSE2
+#define KERNEL_NAME(name) name##SSE2
+#define KERNEL_TARGET __attribute__((target("sse2")))
+#define KERNEL_LANES 4
+#define f32xN __m128
+#define KERNEL_SET1 _mm_set1_ps
+#define KERNEL_SQRT _mm_sqrt_ps
+#define KERNEL_MIN _mm_min_ps
+#define KERNEL_MAX _mm_max_ps
+#define KERNEL_HIT_MASK(a) ((u32)_mm_movemask_ps(_mm_cmpge_ps((a), _mm_setzero_ps())))
+#include "kernels.hpp"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+#undef f32xN
+#undef KERNEL_SET1
+#undef KERNEL_SQRT
+#undef KERNEL_MIN
+#undef KERNEL_MAX
+#undef KERNEL_HIT_MASK
+
+#define KERNEL_NAME(name) name##AVX2
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#define KERNEL_LANES 8
+#define f32xN __m256
+#define KERNEL_SET1 _mm256_set1_ps
+#define KERNEL_SQRT _mm256_sqrt_ps
+#define KERNEL_MIN _mm256_min_ps
+#define KERNEL_MAX _mm256_max_ps
+#define KERNEL_HIT_MASK(a) ((u32)_mm256_movemask_ps(_mm256_cmp_ps((a), _mm256_setzero_ps(), _CMP_GE_OQ)))
+#include "kernels.hpp"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+#undef f32xN
+#undef KERNEL_SET1
+#undef KERNEL_SQRT
+#undef KERNEL_MIN
+#undef KERNEL_MAX
+#undef KERNEL_HIT_MASK
+
+#define KERNEL_NAME(name) name##AVX512
+#define KERNEL_TARGET __attribute__((target("avx512f")))
+#define KERNEL_LANES 16
+#define f32xN __m512
+#define KERNEL_SET1 _mm512_set1_ps
+#define KERNEL_SQRT _mm512_sqrt_ps
+#define KERNEL_MIN _mm512_min_ps
+#define KERNEL_MAX _mm512_max_ps
+#define KERNEL_HIT_MASK(a) ((u32)_mm512_cmp_ps_mask((a), _mm512_setzero_ps(), _CMP_GE_OQ))
+#include "kernels.hpp"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+#undef f32xN
+#undef KERNEL_SET1
+#undef KERNEL_SQRT
+#undef KERNEL_MIN
+#undef KERNEL_MAX
+#undef KERNEL_HIT_MASK
+
+#else
+// -----------------------------------------------
+// @denpa: Without x86, the generic kernels use plain vectors and let the compiler do what it can.
+// -----------------------------------------------
+typedef f32 f32x4 __attribute__((vector_size(16)));
+
+INTERNAL DINLINE f32x4 setGenericLanes(f32 value) {return f32x4 {value, value, value, value};}
+INTERNAL DINLINE f32x4 sqrtGenericLanes(f32x4 a) {return f32x4 {sqrtf(a[0]), sqrtf(a[1]), sqrtf(a[2]), sqrtf(a[3])};}
+INTERNAL DINLINE f32x4 minGenericLanes(f32x4 a, f32x4 b) {return f32x4 {DENPA_MIN(a[0], b[0]), DENPA_MIN(a[1], b[1]), DENPA_MIN(a[2], b[2]), DENPA_MIN(a[3], b[3])};}
+INTERNAL DINLINE u32 hitMaskGenericLanes(f32x4 a) {return (u32)(a[0] >= 0.f) | ((u32)(a[1] >= 0.f) << 1) | ((u32)(a[2] >= 0.f) << 2) | ((u32)(a[3] >= 0.f) << 3);}
+INTERNAL DINLINE f32x4 maxGenericLanes(f32x4 a, f32x4 b) {return f32x4 {DENPA_MAX(a[0], b[0]), DENPA_MAX(a[1], b[1]), DENPA_MAX(a[2], b[2]), DENPA_MAX(a[3], b[3])};}
+
+#define KERNEL_NAME(name) name##Generic
+#define KERNEL_TARGET
+#define KERNEL_LANES 4
+#define f32xN f32x4
+#define KERNEL_SET1 setGenericLanes
+#define KERNEL_SQRT sqrtGenericLanes
+#define KERNEL_MIN minGenericLanes
+#define KERNEL_MAX maxGenericLanes
+#define KERNEL_HIT_MASK hitMaskGenericLanes
+#include "kernels.hpp"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+#undef f32xN
+#undef KERNEL_SET1
+#undef KERNEL_SQRT
+#undef KERNEL_MIN
+#undef KERNEL_MAX
+#undef KERNEL_HIT_MASK
+#endif
+
+// -----------------------------------------------
+// @denpa: The kernels used by the rest of the program. They point at the baseline kernels until selectKernels() is called.
+// Only the ray-shape intersections and the colour clamping are dispatched. The shading, the matrices and the denoiser
+// are compiled for the baseline instruction set (SSE2 on x86) and don't change with the kernels picked here.
+// The shape kernels are indexed by shapeType. The closest hit kernels only look for hits below maximumT,
+// and return the index of the hit shape or SHAPE_SET_MISS. tOut is only written when something was hit.
+// -----------------------------------------------
+typedef u64 (*findClosestShapeKernel)(const shapeSet* set, tuple rayOrigin, tuple rayDirection, f32 maximumT, f32* tOut);
+typedef bool (*isAnyShapeHitKernel)(const shapeSet* set, tuple rayOrigin, tuple rayDirection, f32 maximumT);
+
+typedef struct cpuKernels {
+	findClosestShapeKernel findClosestShape[SHAPE_TYPE_COUNT];
+	isAnyShapeHitKernel isAnyShapeHit[SHAPE_TYPE_COUNT];
+	void (*clampAndScaleColours)(colour* pixels, u64 pixelCount);
+	instructionSet instructionSet;
+} cpuKernels;
+
+#define CPU_KERNELS(suffix, set) \
+	cpuKernels {{findClosestSphere##suffix, findClosestPlane##suffix, findClosestBox##suffix, findClosestCylinder##suffix, findClosestCone##suffix}, \
+				{isAnySphereHit##suffix, isAnyPlaneHit##suffix, isAnyBoxHit##suffix, isAnyCylinderHit##suffix, isAnyConeHit##suffix}, \
+				clampAndScaleColours##suffix, set}
+
+#if DENPA_SIMD_SSE2
+GLOBAL_VARIABLE cpuKernels kernels = CPU_KERNELS(SSE2, INSTRUCTION_SET_SSE2);
+#else
+GLOBAL_VARIABLE cpuKernels kernels = CPU_KERNELS(Generic, INSTRUCTION_SET_GENERIC);
+#endif
+
+// -----------------------------------------------
+// @denpa: Finds the fastest instruction set both the CPU and the OS support.
+// AVX and AVX-512 also need the OS to save the wider registers on context switches, which is checked with xgetbv.
+// -----------------------------------------------
+INTERNAL DNOINLINE instructionSet detectInstructionSet(void) {
+#if DENPA_SIMD_SSE2
+	u32 registers[4] = {};
+#if defined(_MSC_VER) && !defined(__clang__)
+	__cpuidex((int*)registers, 1, 0);
+#else
+	__cpuid_count(1, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	bool hasOSXSAVE = registers[2] & (1u << 27);
+	bool hasAVX = registers[2] & (1u << 28);
+	if (!hasOSXSAVE || !hasAVX) {return INSTRUCTION_SET_SSE2;}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	u64 enabledState = _xgetbv(0);
+	__cpuidex((int*)registers, 7, 0);
+#else
+	u32 low = 0;
+	u32 high = 0;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	u64 enabledState = ((u64)high << 32) | low;
+	__cpuid_count(7, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	bool hasAVX2 = registers[1] & (1u << 5);
+	bool hasAVX512 = registers[1] & (1u << 16);
+	bool savesAVX = (enabledState & 0x6) == 0x6;
+	bool savesAVX512 = (enabledState & 0xE6) == 0xE6;
+
+	if (hasAVX512 && savesAVX512) {return INSTRUCTION_SET_AVX512;}
+	if (hasAVX2 && savesAVX) {return INSTRUCTION_SET_AVX2;}
+	return INSTRUCTION_SET_SSE2;
+#else
+	return INSTRUCTION_SET_GENERIC;
+#endif
+}
+
+// -----------------------------------------------
+// @denpa: Returns the kernel table of the instruction set, which has to be supported by the CPU.
+// Without x86 every instruction set gets the generic kernels, and on x86 the generic one gets the SSE2 kernels.
+// -----------------------------------------------
+INTERNAL DNOINLINE cpuKernels getInstructionSetKernels(UNUSED instructionSet set) {
+#if DENPA_SIMD_SSE2
+	switch (set) {
+		case INSTRUCTION_SET_AVX512: return CPU_KERNELS(AVX512, INSTRUCTION_SET_AVX512);
+		case INSTRUCTION_SET_AVX2: return CPU_KERNELS(AVX2, INSTRUCTION_SET_AVX2);
+		case INSTRUCTION_SET_SSE2:
+		case INSTRUCTION_SET_GENERIC: break;
+	}
+	return CPU_KERNELS(SSE2, INSTRUCTION_SET_SSE2);
+#else
+	return CPU_KERNELS(Generic, INSTRUCTION_SET_GENERIC);
+#endif
+}
+
+// -----------------------------------------------
+// @denpa: Points the kernel table at the fastest supported kernels, or at the requested ones if given and supported.
+// Prints which kernels ended up being used, and what they are used for.
+// -----------------------------------------------
+INTERNAL DNOINLINE void selectKernels(const char* requested) {
+	instructionSet supported = detectInstructionSet();
+	instructionSet selected = supported;
+	if (requested) {
+		u32 i = 0;
+		while (i < DENPA_ARRAY_SIZE(instructionSetNames) && strcmp(requested, instructionSetNames[i]) != 0) {i++;}
+		if (i == DENPA_ARRAY_SIZE(instructionSetNames)) {
+			printf("Unknown instruction set: %s\n", requested);
+		} else if ((instructionSet)i > supported || ((i == INSTRUCTION_SET_GENERIC) != (supported == INSTRUCTION_SET_GENERIC))) {
+			printf("The %s kernels are not supported on this CPU.\n", requested);
+		} else {
+			selected = (instructionSet)i;
+		}
+	}
+
+	kernels = getInstructionSetKernels(selected);
+	printf("Using the %s kernels for the ray-shape intersections and the colour clamping.\n", instructionSetNames[kernels.instructionSet]);
+}
@@ -0,0 +1,276 @@
+//  culling.hpp
+//  Contains the screen space binning of the shapes, which lets camera rays skip the shapes that can't be in their tile
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: The shapes that overlap every tile of the canvas, as lists of shape indices by type.
+// The shapes of a type in tile i are indices[type][offsets[type][i]] up to indices[type][offsets[type][i + 1]].
+// The camera is described here as well, since the bins only make sense for the rays of that camera and tile size.
+// -----------------------------------------------
+typedef struct screenBins {
+	point eye = createPoint(0.f, 0.f, 0.f);
+	f32 wallZ = 0.f;
+	f32 wallSize = 0.f;
+	u32 canvasX = 0;
+	u32 canvasY = 0;
+	u32 tileSize = 0;
+	u32 tilesX = 0;
+	u32 tilesY = 0;
+	u64* offsets[SHAPE_TYPE_COUNT] = {};
+	u64* indices[SHAPE_TYPE_COUNT] = {};
+} screenBins;
+
+// -----------------------------------------------
+// @denpa: The shapes of one tile, copied into small shape sets so that the SIMD kernels only go through them.
+// indices maps a shape in the small sets back to the shape in the world.
+// -----------------------------------------------
+typedef struct tileCandidates {
+	shapeSet sets[SHAPE_TYPE_COUNT] = {};
+	u64* indices[SHAPE_TYPE_COUNT] = {};
+} tileCandidates;
+
+// -----------------------------------------------
+// @denpa: A rectangle of tiles, both ends included. It is empty when the start is past the end.
+// -----------------------------------------------
+typedef struct tileRectangle {
+	i64 startX = 0;
+	i64 startY = 0;
+	i64 endX = -1;
+	i64 endY = -1;
+} tileRectangle;
+
+// -----------------------------------------------
+// @denpa: Every tile of the canvas.
+// -----------------------------------------------
+INTERNAL DINLINE tileRectangle getAllTiles(screenBins* bins) {
+	return tileRectangle {.startX = 0, .startY = 0, .endX = bins->tilesX - 1, .endY = bins->tilesY - 1};
+}
+
+// -----------------------------------------------
+// @denpa: Finds the tiles the object space bounding box can show up in.
+// The corners are projected onto the wall, and the rectangle around them is grown by a pixel so that rounding can't drop a tile.
+// A box entirely behind the camera covers nothing, and a box that is partly behind it covers everything.
+// -----------------------------------------------
+INTERNAL DNOINLINE tileRectangle findBoundsTiles(screenBins* bins, matrix4x4 transformation, point minimum, point maximum) {
+	f32 minimumX = INFINITY;
+	f32 minimumY = INFINITY;
+	f32 maximumX = -INFINITY;
+	f32 maximumY = -INFINITY;
+	u32 behindCount = 0;
+	for (u32 corner = 0; corner < 8; corner++) {
+		point objectCorner = createPoint((corner & 1) ? maximum.x : minimum.x, (corner & 2) ? maximum.y : minimum.y, (corner & 4) ? maximum.z : minimum.z);
+		vector direction = subtractTuples(multiplyMatrix4x4Tuple(transformation, objectCorner), bins->eye);
+		if (direction.z <= EPSILON) {behindCount++; continue;}
+		f32 scale = (bins->wallZ - bins->eye.z) / direction.z;
+		minimumX = DENPA_MIN(minimumX, bins->eye.x + (direction.x * scale));
+		maximumX = DENPA_MAX(maximumX, bins->eye.x + (direction.x * scale));
+		minimumY = DENPA_MIN(minimumY, bins->eye.y + (direction.y * scale));
+		maximumY = DENPA_MAX(maximumY, bins->eye.y + (direction.y * scale));
+	}
+	if (behindCount == 8) {return tileRectangle {};}
+	if (behindCount > 0) {return getAllTiles(bins);}
+
+	f32 half = bins->wallSize / 2.f;
+	f32 pixelSize = bins->wallSize / (f32)bins->canvasX;
+	f32 startX = floorf((minimumX + half) / pixelSize) - 1.f;
+	f32 endX = floorf((maximumX + half) / pixelSize) + 1.f;
+	f32 startY = floorf((half - maximumY) / pixelSize) - 1.f;
+	f32 endY = floorf((half - minimumY) / pixelSize) + 1.f;
+	if (endX < 0.f || endY < 0.f || startX >= (f32)bins->canvasX || startY >= (f32)bins->canvasY) {return tileRectangle {};}
+
+	startX = DENPA_MAX(startX, 0.f);
+	startY = DENPA_MAX(startY, 0.f);
+	endX = DENPA_MIN(endX, (f32)(bins->canvasX - 1));
+	endY = DENPA_MIN(endY, (f32)(bins->canvasY - 1));
+	return tileRectangle {.startX = (i64)startX / bins->tileSize, .startY = (i64)startY / bins->tileSize,
+						  .endX = (i64)endX / bins->tileSize, .endY = (i64)endY / bins->tileSize};
+}
+
+// -----------------------------------------------
+// @denpa: Finds the tiles a shape can show up in. Planes, and cylinders and cones without both ends, have no bounds,
+// so they go in every tile and planes are then tested tile by tile with isPlaneInTile().
+// -----------------------------------------------
+INTERNAL DNOINLINE tileRectangle findShapeTiles(screenBins* bins, world* world, shapeType type, u64 index) {
+	switch (type) {
+		case SHAPE_SPHERE: {
+			sphere* sphere = &world->spheres[index];
+			vector radius = createVector(1.f, 1.f, 1.f);
+			return findBoundsTiles(bins, sphere->transformation, subtractTuples(sphere->origin, radius), addTuples(sphere->origin, radius));
+		}
+		case SHAPE_BOX: return findBoundsTiles(bins, world->boxes[index].transformation, world->boxes[index].minimum, world->boxes[index].maximum);
+		case SHAPE_CYLINDER: {
+			cylinder* cylinder = &world->cylinders[index];
+			if (!(cylinder->minimum > -INFINITY && cylinder->maximum < INFINITY)) {return getAllTiles(bins);}
+			return findBoundsTiles(bins, cylinder->transformation, createPoint(-1.f, cylinder->minimum, -1.f), createPoint(1.f, cylinder->maximum, 1.f));
+		}
+		case SHAPE_CONE: {
+			cone* cone = &world->cones[index];
+			if (!(cone->minimum > -INFINITY && cone->maximum < INFINITY)) {return getAllTiles(bins);}
+			f32 radius = DENPA_MAX(fabsf(cone->minimum), fabsf(cone->maximum));
+			return findBoundsTiles(bins, cone->transformation, createPoint(-radius, cone->minimum, -radius), createPoint(radius, cone->maximum, radius));
+		}
+		case SHAPE_PLANE: return getAllTiles(bins);
+		case SHAPE_TYPE_COUNT: break;
+	}
+	return tileRectangle {};
+}
+
+// -----------------------------------------------
+// @denpa: Checks if any camera ray through the tile can hit the plane. A ray hits the plane when it heads towards it,
+// and that only depends on the direction of the ray, so the rays through the corners of the tile decide for the whole tile.
+// The corners are moved out by a pixel, the same margin the bounding boxes get.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool isPlaneInTile(screenBins* bins, plane* plane, u32 tileX, u32 tileY) {
+	point planePoint = multiplyMatrix4x4Tuple(plane->transformation, createPoint(0.f, 0.f, 0.f));
+	vector normal = objectToWorldNormal(plane->inverseTransformation, createVector(0.f, 1.f, 0.f));
+	f32 eyeDistance = dotProduct(normal, subtractTuples(bins->eye, planePoint));
+	if (fabsf(eyeDistance) < EPSILON) {return true;}
+
+	f32 half = bins->wallSize / 2.f;
+	f32 pixelSize = bins->wallSize / (f32)bins->canvasX;
+	f32 startX = (f32)(tileX * bins->tileSize) - 1.f;
+	f32 startY = (f32)(tileY * bins->tileSize) - 1.f;
+	f32 endX = (f32)DENPA_MIN((tileX + 1) * bins->tileSize, bins->canvasX) + 1.f;
+	f32 endY = (f32)DENPA_MIN((tileY + 1) * bins->tileSize, bins->canvasY) + 1.f;
+	for (u32 corner = 0; corner < 4; corner++) {
+		f32 x = (corner & 1) ? endX : startX;
+		f32 y = (corner & 2) ? endY : startY;
+		point wallPoint = createPoint(-half + (pixelSize * x), half - (pixelSize * y), bins->wallZ);
+		if (eyeDistance * dotProduct(normal, subtractTuples(wallPoint, bins->eye)) < 0.f) {return true;}
+	}
+	return false;
+}
+
+// -----------------------------------------------
+// @denpa: Calls visit(tile) for every tile the shape can show up in.
+// -----------------------------------------------
+template <typename function>
+INTERNAL DINLINE void visitShapeTiles(screenBins* bins, world* world, shapeType type, u64 index, function visit) {
+	tileRectangle tiles = findShapeTiles(bins, world, type, index);
+	for (i64 tileY = tiles.startY; tileY <= tiles.endY; tileY++) {
+		for (i64 tileX = tiles.startX; tileX <= tiles.endX; tileX++) {
+			if (type == SHAPE_PLANE && !isPlaneInTile(bins, &world->planes[index], (u32)tileX, (u32)tileY)) {continue;}
+			visit(((u64)tileY * bins->tilesX) + (u64)tileX);
+		}
+	}
+}
+
+// -----------------------------------------------
+// @denpa: Sorts the shapes of the world into the tiles of the canvas. The camera and the tiles have to be filled in already.
+// The lists are built in the culling arena, which is created again whenever it is too small for them.
+// The shape indices of every tile are in increasing order, like in the world.
+// Returns false when the shape sets are out of date, since the tile sets are copied from them.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool binShapesOnScreen(screenBins* bins, world* world) {
+	if (world->shapeSetsDirty) {return false;}
+
+	u64 tileCount = (u64)bins->tilesX * bins->tilesY;
+	u64 offsetsSize = (sizeof(u64) * (tileCount + 1) + ARENA_DEFAULT_ALIGNMENT) * SHAPE_TYPE_COUNT;
+	if (memory.culling.size < offsetsSize) {
+		destroyArena(&memory.culling);
+		memory.culling = createArena("culling", offsetsSize, false);
+	}
+	resetArena(&memory.culling);
+
+	// @denpa: Counts the shapes in every tile first, which gives the size of the lists.
+	u64 entryCount = 0;
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		u64* counts = PUSH_ARRAY(&memory.culling, u64, tileCount + 1);
+		memset(counts, 0, sizeof(u64) * (tileCount + 1));
+		for (u64 i = 0; i < getShapeCount(world, (shapeType)type); i++) {
+			visitShapeTiles(bins, world, (shapeType)type, i, [&](u64 tile) {counts[tile + 1]++;});
+		}
+		for (u64 tile = 0; tile < tileCount; tile++) {counts[tile + 1] += counts[tile];}
+		entryCount += counts[tileCount];
+		bins->offsets[type] = counts;
+	}
+
+	u64 size = memory.culling.used + (sizeof(u64) * entryCount) + (ARENA_DEFAULT_ALIGNMENT * SHAPE_TYPE_COUNT);
+	if (memory.culling.size < size) {
+		memoryArena arena = createArena("culling", size, false);
+		for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+			u64* offsets = PUSH_ARRAY(&arena, u64, tileCount + 1);
+			memcpy(offsets, bins->offsets[type], sizeof(u64) * (tileCount + 1));
+			bins->offsets[type] = offsets;
+		}
+		destroyArena(&memory.culling);
+		memory.culling = arena;
+	}
+
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		u64* offsets = bins->offsets[type];
+		u64* indices = PUSH_ARRAY(&memory.culling, u64, offsets[tileCount]);
+		for (u64 i = 0; i < getShapeCount(world, (shapeType)type); i++) {
+			// @denpa: The offsets are used as the write cursors and moved back by one tile at the end.
+			visitShapeTiles(bins, world, (shapeType)type, i, [&](u64 tile) {indices[offsets[tile]++] = i;});
+		}
+		for (u64 tile = tileCount; tile > 0; tile--) {offsets[tile] = offsets[tile - 1];}
+		offsets[0] = 0;
+		bins->indices[type] = indices;
+	}
+	return true;
+}
+
+// -----------------------------------------------
+// @denpa: Returns the tile the pixel is in.
+// -----------------------------------------------
+INTERNAL DINLINE u64 getPixelTile(screenBins* bins, u32 x, u32 y) {
+	return ((u64)(y / bins->tileSize) * bins->tilesX) + (x / bins->tileSize);
+}
+
+// -----------------------------------------------
+// @denpa: Checks if no shape at all can show up in the tile, in which case every camera ray through it misses.
+// -----------------------------------------------
+INTERNAL DINLINE bool isTileEmpty(screenBins* bins, u64 tile) {
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		if (bins->offsets[type][tile + 1] > bins->offsets[type][tile]) {return false;}
+	}
+	return true;
+}
+
+// -----------------------------------------------
+// @denpa: Copies the shapes of the tile out of the shape sets of the world, into shape sets allocated from the arena.
+// Returns false without allocating anything if they don't fit in the arena, the whole world has to be used for the tile then.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool gatherTileCandidates(screenBins* bins, world* world, u64 tile, memoryArena* arena, tileCandidates* candidates) {
+	u64 size = 0;
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		u64 count = bins->offsets[type][tile + 1] - bins->offsets[type][tile];
+		u64 paddedCount = ((count + SHAPE_SET_PADDING - 1) / SHAPE_SET_PADDING) * SHAPE_SET_PADDING;
+		size += (sizeof(f32) * shapeSetArrayCounts[type] * paddedCount) + ARENA_DEFAULT_ALIGNMENT;
+	}
+	if (arena->used + size > arena->size) {return false;}
+
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		shapeSet* source = &world->shapeSets[type];
+		u64* indices = &bins->indices[type][bins->offsets[type][tile]];
+		u64 count = bins->offsets[type][tile + 1] - bins->offsets[type][tile];
+		shapeSet set = {.count = count, .paddedCount = ((count + SHAPE_SET_PADDING - 1) / SHAPE_SET_PADDING) * SHAPE_SET_PADDING};
+		set.data = PUSH_ARRAY(arena, f32, shapeSetArrayCounts[type] * set.paddedCount);
+		memset(set.data, 0, sizeof(f32) * shapeSetArrayCounts[type] * set.paddedCount);
+		for (u64 array = 0; array < shapeSetArrayCounts[type]; array++) {
+			f32* from = &source->data[array * source->paddedCount];
+			f32* to = &set.data[array * set.paddedCount];
+			for (u64 i = 0; i < count; i++) {to[i] = from[indices[i]];}
+		}
+		candidates->sets[type] = set;
+		candidates->indices[type] = indices;
+	}
+	return true;
+}
+
+// -----------------------------------------------
+// @denpa: Finds the closest hit of a camera ray among the shapes of its tile. The hit refers to the shape in the world.
+// -----------------------------------------------
+INTERNAL DINLINE worldHit findCandidateHit(tileCandidates* candidates, ray ray) {
+	worldHit closest = {};
+	f32 closestT = INFINITY;
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		if (candidates->sets[type].count == 0) {continue;}
+		u64 index = kernels.findClosestShape[type](&candidates->sets[type], ray.rayOrigin, ray.rayDirection, closestT, &closestT);
+		if (index != SHAPE_SET_MISS) {closest = (worldHit) {.index = candidates->indices[type][index], .type = (shapeType)type, .t = closestT};}
+	}
+	return closest;
+}
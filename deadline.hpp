@@ -0,0 +1,273 @@
+//  deadline.hpp
+//  Contains the deadline renderer, which lowers the quality tile by tile so that the frame is done in time
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: Before the frame, one pixel out of every probe stride by probe stride block is traced with every shading quality,
+// which gives the cost of a sample in every tile. A part of the deadline is held back for finishing the image.
+// While rendering, the tiles left are only planned again once the frame is behind or ahead by more than the slack, a part of the deadline,
+// since a plan that just fits is always a little behind, if only from clearing the empty tiles, which the probe can't see.
+// -----------------------------------------------
+#define DEADLINE_PROBE_STRIDE 8
+#define DEADLINE_RESERVE 0.05
+#define DEADLINE_SLACK 0.05
+#define SHADING_QUALITY_COUNT 2
+#define MAX_QUALITY_LEVEL_COUNT 40
+
+// -----------------------------------------------
+// @denpa: One step of the quality ladder. The ladder starts at the full quality of the render settings, halves the samples
+// per pixel down to 1, then traces fewer pixels, and only drops the shadows as a last resort,
+// since shadows that come and go from tile to tile stand out much more than blocky tiles.
+// -----------------------------------------------
+typedef struct qualityLevel {
+	u32 samplesPerPixel = 1;
+	shadingQuality shading = SHADING_FULL;
+	u32 resolutionScale = 1;
+} qualityLevel;
+
+// -----------------------------------------------
+// @denpa: What the deadline renderer knows about a tile. The sample costs are in seconds, by shading quality.
+// The level of a tile can still be changed by the plan until it has started.
+// -----------------------------------------------
+typedef struct deadlineTile {
+	f64 sampleCosts[SHADING_QUALITY_COUNT] = {};
+	u32 level = 0;
+	bool started = false;
+} deadlineTile;
+
+// -----------------------------------------------
+// @denpa: The number of bytes renderDeadlineImage() needs from the arena, padding for alignment included.
+// -----------------------------------------------
+INTERNAL DINLINE u64 deadlineMemorySize(renderSettings* settings) {
+	u64 tileCount = (u64)((settings->canvasX + settings->tileSize - 1) / settings->tileSize) * ((settings->canvasY + settings->tileSize - 1) / settings->tileSize);
+	return (sizeof(deadlineTile) * tileCount) + ARENA_DEFAULT_ALIGNMENT;
+}
+
+// -----------------------------------------------
+// @denpa: Fills in the quality ladder for the render settings, from the best quality to the cheapest, and returns its length.
+// -----------------------------------------------
+INTERNAL DNOINLINE u32 createQualityLadder(renderSettings* settings, qualityLevel* levels) {
+	u32 levelCount = 0;
+	for (u32 samplesPerPixel = settings->samplesPerPixel; samplesPerPixel >= 1; samplesPerPixel /= 2) {
+		levels[levelCount++] = {.samplesPerPixel = samplesPerPixel, .shading = SHADING_FULL, .resolutionScale = 1};
+	}
+	levels[levelCount++] = {.samplesPerPixel = 1, .shading = SHADING_FULL, .resolutionScale = 2};
+	levels[levelCount++] = {.samplesPerPixel = 1, .shading = SHADING_FULL, .resolutionScale = 4};
+	levels[levelCount++] = {.samplesPerPixel = 1, .shading = SHADING_NO_SHADOWS, .resolutionScale = 4};
+	return levelCount;
+}
+
+// -----------------------------------------------
+// @denpa: The expected time it takes to render a tile with the given number of pixels at a quality level, in seconds.
+// -----------------------------------------------
+INTERNAL DINLINE f64 estimateTileCost(deadlineTile* tile, qualityLevel* level, u32 width, u32 height) {
+	u64 tracedPixelCount = (u64)((width + level->resolutionScale - 1) / level->resolutionScale) * ((height + level->resolutionScale - 1) / level->resolutionScale);
+	return tile->sampleCosts[level->shading] * (f64)(tracedPixelCount * level->samplesPerPixel);
+}
+
+// -----------------------------------------------
+// @denpa: The quality level the given number of steps down the ladder from level, or the cheapest one.
+// -----------------------------------------------
+INTERNAL DINLINE u32 lowerQualityLevel(u32 level, u32 steps, u32 levelCount) {
+	return DENPA_MIN(level + steps, levelCount - 1);
+}
+
+// -----------------------------------------------
+// @denpa: Measures the time a sample takes in the tile with every shading quality. Nothing is written to the frame buffer.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics probeTile(world* world, camera* camera, renderSettings* settings, memoryArena* scratch, screenBins* bins,
+											  deadlineTile* tile, u32 startX, u32 startY, u32 endX, u32 endY) {
+	renderStatistics statistics = {};
+	if (bins && isTileEmpty(bins, getPixelTile(bins, startX, startY))) {return statistics;}
+
+	temporaryMemory temporary = beginTemporaryMemory(scratch);
+	tileCandidates candidates = {};
+	tileCandidates* tileShapes = NULL;
+	if (bins && gatherTileCandidates(bins, world, getPixelTile(bins, startX, startY), scratch, &candidates)) {tileShapes = &candidates;}
+
+	for (u32 shading = 0; shading < SHADING_QUALITY_COUNT; shading++) {
+		renderSettings probeSettings = *settings;
+		probeSettings.shading = (shadingQuality)shading;
+		u64 sampleCount = 0;
+		f64 startTime = getWallClockSeconds();
+		for (u32 y = startY; y < endY; y += DEADLINE_PROBE_STRIDE) {
+			for (u32 x = startX; x < endX; x += DEADLINE_PROBE_STRIDE) {
+				vector normal = createVector(0.f, 0.f, 0.f);
+				f32 depth = 0.f;
+				tracePixelSample(world, tileShapes, camera, &probeSettings, x, y, 0, &normal, &depth);
+				statistics.shadowRays += (shading == SHADING_FULL && depth > 0.f) ? world->lightCount : 0;
+				sampleCount++;
+			}
+		}
+		tile->sampleCosts[shading] = (getWallClockSeconds() - startTime) / (f64)sampleCount;
+		statistics.cameraRays += sampleCount;
+	}
+	endTemporaryMemory(temporary);
+	return statistics;
+}
+
+// -----------------------------------------------
+// @denpa: Renders the world so that it is done within settings->deadline milliseconds, and prints the quality that was used.
+// After probing, every tile is lowered by the same number of levels, the fewest that fit in the time left.
+// When that is more than needed, the cheapest tiles, which are the flat and empty ones, take one more step down
+// until the frame fits, so the tiles covering the objects keep their quality the longest.
+// While rendering, the time the finished tiles took is compared with their estimates, and when the frame falls behind,
+// the tiles that haven't started yet are planned again the same way, with the time that is left.
+// The same goes for a frame that gets ahead, so that a few slow tiles at the start don't lower the rest of the frame for good.
+// The frame buffer is then ready to be written out, just like after renderImage().
+// The arena needs deadlineMemorySize() bytes to spare, which are given back before denoising.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics renderDeadlineImage(world* world, camera* camera, renderSettings* settings, frameBuffer* buffer, memoryArena* arena) {
+	f64 startTime = getWallClockSeconds();
+	f64 deadline = (f64)settings->deadline / 1000.0;
+	qualityLevel levels[MAX_QUALITY_LEVEL_COUNT] = {};
+	u32 levelCount = createQualityLadder(settings, levels);
+
+	u32 tilesX = (settings->canvasX + settings->tileSize - 1) / settings->tileSize;
+	u32 tilesY = (settings->canvasY + settings->tileSize - 1) / settings->tileSize;
+	u32 tileCount = tilesX * tilesY;
+	u32 threadCount = DENPA_MIN(resolveThreadCount(settings->threadCount), tileCount);
+	temporaryMemory temporary = beginTemporaryMemory(arena);
+	deadlineTile* tiles = PUSH_ARRAY(arena, deadlineTile, tileCount);
+	for (u32 i = 0; i < tileCount; i++) {tiles[i] = {};}
+	screenBins binStorage = {};
+	screenBins* bins = prepareScreenBins(world, camera, settings, &binStorage);
+
+	renderStatistics threadStatistics[MAX_THREAD_COUNT] = {};
+	auto getTileRectangle = [&](u32 tile, u32* startX, u32* startY, u32* endX, u32* endY) {
+		*startX = (tile % tilesX) * settings->tileSize;
+		*startY = (tile / tilesX) * settings->tileSize;
+		*endX = DENPA_MIN(*startX + settings->tileSize, settings->canvasX);
+		*endY = DENPA_MIN(*startY + settings->tileSize, settings->canvasY);
+	};
+
+	parallelFor(tileCount, settings->threadCount, [&](u32 tile, u32 threadIndex) {
+		u32 startX, startY, endX, endY;
+		getTileRectangle(tile, &startX, &startY, &endX, &endY);
+		renderStatistics tileStatistics = probeTile(world, camera, settings, getScratchArena(threadIndex), bins, &tiles[tile], startX, startY, endX, endY);
+		threadStatistics[threadIndex].cameraRays += tileStatistics.cameraRays;
+		threadStatistics[threadIndex].shadowRays += tileStatistics.shadowRays;
+	});
+	f64 probeTime = getWallClockSeconds() - startTime;
+
+	// @denpa: The cost of the tiles that haven't started when they are all lowered by steps levels,
+	// and the ones that cost less than threshold by one more. The levels are written to the tiles with write set.
+	auto planTiles = [&](u32 steps, f64 threshold, bool write) {
+		f64 total = 0.0;
+		for (u32 tile = 0; tile < tileCount; tile++) {
+			if (tiles[tile].started) {continue;}
+			u32 startX, startY, endX, endY;
+			getTileRectangle(tile, &startX, &startY, &endX, &endY);
+			u32 level = lowerQualityLevel(0, steps, levelCount);
+			if (estimateTileCost(&tiles[tile], &levels[level], endX - startX, endY - startY) < threshold) {level = lowerQualityLevel(level, 1, levelCount);}
+			total += estimateTileCost(&tiles[tile], &levels[level], endX - startX, endY - startY);
+			if (write) {tiles[tile].level = level;}
+		}
+		return total;
+	};
+
+	// @denpa: Finds the fewest steps that fit in the budget. One step fewer doesn't fit, so the lowest threshold
+	// that fits is then found by bisection, which only lowers the cheapest tiles. Returns the cost of the plan.
+	u32 plannedSteps = 0;
+	f64 plannedThreshold = 0.0;
+	auto planRemainingTiles = [&](f64 budget) {
+		u32 steps = 0;
+		while (steps + 1 < levelCount && planTiles(steps, 0.0, false) > budget) {steps++;}
+		f64 threshold = 0.0;
+		if (steps > 0 && planTiles(steps, 0.0, false) <= budget) {
+			steps--;
+			f64 lowThreshold = 0.0;
+			f64 highThreshold = 0.0;
+			for (u32 tile = 0; tile < tileCount; tile++) {
+				u32 startX, startY, endX, endY;
+				getTileRectangle(tile, &startX, &startY, &endX, &endY);
+				highThreshold = DENPA_MAX(highThreshold, 2.0 * estimateTileCost(&tiles[tile], &levels[steps], endX - startX, endY - startY));
+			}
+			for (u32 iteration = 0; iteration < 64; iteration++) {
+				f64 middle = (lowThreshold + highThreshold) * .5;
+				if (planTiles(steps, middle, false) <= budget) {highThreshold = middle;} else {lowThreshold = middle;}
+			}
+			threshold = highThreshold;
+		}
+		plannedSteps = steps;
+		plannedThreshold = threshold;
+		return planTiles(steps, threshold, true);
+	};
+
+	// @denpa: The plan is shared by all the threads, so it is only read or changed with the lock held.
+	// The times are kept in nanoseconds so that the threads can add them up atomically.
+	f64 plannedRemaining = planRemainingTiles(DENPA_MAX((deadline * (1.0 - DEADLINE_RESERVE)) - probeTime, 0.0) * threadCount);
+	std::mutex planLock;
+	std::atomic<u64> finishedEstimate = 0;
+	std::atomic<u64> finishedActual = 0;
+	parallelFor(tileCount, settings->threadCount, [&](u32 tile, u32 threadIndex) {
+		u32 startX, startY, endX, endY;
+		getTileRectangle(tile, &startX, &startY, &endX, &endY);
+		u32 width = endX - startX;
+		u32 height = endY - startY;
+
+		// @denpa: The estimates are corrected by how far off they were for the finished tiles.
+		f64 timeLeft = ((deadline * (1.0 - DEADLINE_RESERVE)) - (getWallClockSeconds() - startTime)) * threadCount;
+		u64 estimate = finishedEstimate.load();
+		f64 correction = estimate ? (f64)finishedActual.load() / (f64)estimate : 1.0;
+		// @denpa: The tiles left are planned again when the frame is behind or ahead by more than the slack,
+		// unless the plan is already as cheap or as good as it gets.
+		planLock.lock();
+		f64 slack = deadline * DEADLINE_SLACK * threadCount;
+		bool behind = plannedRemaining * correction > timeLeft + slack && plannedSteps + 1 < levelCount;
+		bool ahead = plannedRemaining * correction < timeLeft - slack && (plannedSteps > 0 || plannedThreshold > 0.0);
+		if (behind || ahead) {
+			plannedRemaining = planRemainingTiles(DENPA_MAX(timeLeft, 0.0) / correction);
+		}
+		tiles[tile].started = true;
+		plannedRemaining -= estimateTileCost(&tiles[tile], &levels[tiles[tile].level], width, height);
+		planLock.unlock();
+
+		// @denpa: The tile is timed from here, so that the planning isn't counted as rendering.
+		f64 tileStartTime = getWallClockSeconds();
+		qualityLevel* level = &levels[tiles[tile].level];
+		renderSettings tileSettings = *settings;
+		tileSettings.samplesPerPixel = level->samplesPerPixel;
+		tileSettings.shading = level->shading;
+		tileSettings.resolutionScale = level->resolutionScale;
+		memoryArena* scratch = getScratchArena(threadIndex);
+		resetArena(scratch);
+		renderStatistics tileStatistics = renderTile(world, camera, &tileSettings, buffer, scratch, bins, startX, startY, endX, endY);
+		threadStatistics[threadIndex].cameraRays += tileStatistics.cameraRays;
+		threadStatistics[threadIndex].shadowRays += tileStatistics.shadowRays;
+		// @denpa: Empty tiles are expected to take no time at all, so they would only skew the correction.
+		u64 tileEstimate = (u64)(estimateTileCost(&tiles[tile], level, width, height) * 1e9);
+		if (tileEstimate) {
+			finishedEstimate += tileEstimate;
+			finishedActual += (u64)((getWallClockSeconds() - tileStartTime) * 1e9);
+		}
+	});
+
+	renderStatistics statistics = {};
+	for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {
+		statistics.cameraRays += threadStatistics[i].cameraRays;
+		statistics.shadowRays += threadStatistics[i].shadowRays;
+	}
+	u32 levelTileCounts[MAX_QUALITY_LEVEL_COUNT] = {};
+	f64 sampleSum = 0.0;
+	for (u32 tile = 0; tile < tileCount; tile++) {
+		qualityLevel* level = &levels[tiles[tile].level];
+		u32 startX, startY, endX, endY;
+		getTileRectangle(tile, &startX, &startY, &endX, &endY);
+		levelTileCounts[tiles[tile].level]++;
+		sampleSum += (f64)((endX - startX) * (endY - startY)) * level->samplesPerPixel / (f64)(level->resolutionScale * level->resolutionScale);
+	}
+	endTemporaryMemory(temporary);
+	finishImage(settings, buffer, arena);
+
+	printf("Deadline %u ms: done in %.1f ms, %.1f ms of it probing, %.2f samples per pixel on average\n", settings->deadline,
+		   (getWallClockSeconds() - startTime) * 1000.0, probeTime * 1000.0, sampleSum / ((f64)settings->canvasX * settings->canvasY));
+	for (u32 i = 0; i < levelCount; i++) {
+		if (!levelTileCounts[i]) {continue;}
+		printf("%5u tiles: %4u samples per pixel, %-10s shading, 1 pixel out of %u x %u traced\n", levelTileCounts[i], levels[i].samplesPerPixel,
+			   (levels[i].shading == SHADING_FULL) ? "full" : "no shadow", levels[i].resolutionScale, levels[i].resolutionScale);
+	}
+	return statistics;
+}
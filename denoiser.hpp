@@ -0,0 +1,221 @@
+//  denoiser.hpp
+//  Contains the edge-aware à-trous wavelet denoiser that runs on the frame buffer after tracing
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: Controls the strength of the denoiser.
+// Every iteration doubles the distance between the taps, so 5 iterations cover a 125 by 125 pixel area.
+// The colour sigma is halved after every iteration so that the later, wider passes only smooth out what is left of the noise.
+// The normal power and depth sigma stop the filter from blurring across the edges of the objects.
+// The dot product of the normals is raised to the power of 2^6 = 64 by squaring it 6 times.
+// -----------------------------------------------
+#define DENOISE_ITERATION_COUNT 5
+#define DENOISE_COLOUR_SIGMA 0.8f
+#define DENOISE_NORMAL_POWER_SQUARINGS 6
+#define DENOISE_DEPTH_SIGMA 0.02f
+
+// -----------------------------------------------
+// @denpa: The weights of the 5 taps of the B3 spline, the 5 by 5 kernel is the outer product of this with itself.
+// -----------------------------------------------
+GLOBAL_VARIABLE const f32 denoiseKernel[5] = {1.f/16.f, 1.f/4.f, 3.f/8.f, 1.f/4.f, 1.f/16.f};
+
+// -----------------------------------------------
+// @denpa: Raises the dot product of two normals to the normal power.
+// -----------------------------------------------
+INTERNAL DINLINE f32 raiseToNormalPower(f32 normalDot) {
+	for (u32 i = 0; i < DENOISE_NORMAL_POWER_SQUARINGS; i++) {normalDot *= normalDot;}
+	return normalDot;
+}
+
+// -----------------------------------------------
+// @denpa: Filters a single pixel with one iteration of the filter.
+// -----------------------------------------------
+INTERNAL DINLINE void denoisePixel(frameBuffer* buffer, colour* input, colour* output, u32 y, i32 x, i32 stepWidth, f32 inverseColourVariance) {
+	i32 width = (i32)buffer->width;
+	i32 height = (i32)buffer->height;
+	u32 p = (y * buffer->width) + (u32)x;
+	colour centreColour = input[p];
+	vector centreNormal = buffer->normals[p];
+	f32 centreDepth = buffer->depths[p];
+
+	// @denpa: Nothing was hit, so there is nothing to denoise.
+	if (centreDepth <= 0.f) {output[p] = centreColour; return;}
+
+	f32 inverseDepthScale = 1.f / (DENOISE_DEPTH_SIGMA * centreDepth * (f32)stepWidth);
+	f32 weightSum = 0.f;
+	colour colourSum = createColour(0.f, 0.f, 0.f, 0.f);
+	for (i32 ky = -2; ky <= 2; ky++) {
+		i32 qy = (i32)y + (ky * stepWidth);
+		if (qy < 0 || qy >= height) {continue;}
+		for (i32 kx = -2; kx <= 2; kx++) {
+			i32 qx = x + (kx * stepWidth);
+			if (qx < 0 || qx >= width) {continue;}
+
+			u32 q = ((u32)qy * buffer->width) + (u32)qx;
+			f32 normalDot = dotProduct(centreNormal, buffer->normals[q]);
+			if (normalDot <= 0.f) {continue;}
+
+			colour sampleColour = input[q];
+			colour difference = subtractTuples(centreColour, sampleColour);
+			f32 colourDistance = (difference.r*difference.r) + (difference.g*difference.g) + (difference.b*difference.b);
+			f32 exponent = (colourDistance * inverseColourVariance) + (fabsf(centreDepth - buffer->depths[q]) * inverseDepthScale);
+			f32 weight = denoiseKernel[kx + 2] * denoiseKernel[ky + 2] * expf(-exponent) * raiseToNormalPower(normalDot);
+			colourSum = addTuples(colourSum, scaleTuple(sampleColour, weight));
+			weightSum += weight;
+		}
+	}
+
+	output[p] = (weightSum <= 0.f) ? centreColour : scaleTuple(colourSum, 1.f / weightSum);
+}
+
+#if DENPA_SIMD_SSE2
+// -----------------------------------------------
+// @denpa: Approximates e^x in every lane, to about 2e-7 relative error. Results below e^-87 are flushed to that.
+// 2^f for the fraction of x * log2(e) comes from a degree 5 minimax polynomial, and the integer part goes into the exponent bits.
+// -----------------------------------------------
+INTERNAL DINLINE __m128 fastExp4(__m128 x) {
+	__m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-87.f)), _mm_set1_ps(1.44269504f));
+	__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+	whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, t), _mm_set1_ps(1.f)));
+	__m128 fraction = _mm_sub_ps(t, whole);
+
+	__m128 p = _mm_set1_ps(1.8775767e-3f);
+	p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(8.9893397e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(5.5826318e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(2.4015361e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(6.9315308e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(9.9999994e-1f));
+	__m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(exponent));
+}
+
+// -----------------------------------------------
+// @denpa: Loads 4 tuples and transposes them, so that every register holds one component of all 4.
+// -----------------------------------------------
+INTERNAL DINLINE void loadTransposedTuples4(tuple* a, tuple* b, tuple* c, tuple* d, __m128 out[4]) {
+	out[0] = _mm_loadu_ps(&a->x);
+	out[1] = _mm_loadu_ps(&b->x);
+	out[2] = _mm_loadu_ps(&c->x);
+	out[3] = _mm_loadu_ps(&d->x);
+	_MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+}
+
+// -----------------------------------------------
+// @denpa: Filters 4 neighbouring pixels of a row with one iteration of the filter, one pixel per lane.
+// The weights are computed in the lanes too, taps past the edge of the image are read from the edge and get no weight.
+// Gives the same result as denoisePixel() up to the error of fastExp4().
+// -----------------------------------------------
+INTERNAL DINLINE void denoisePixels4(frameBuffer* buffer, colour* input, colour* output, u32 y, i32 x, i32 stepWidth, f32 inverseColourVariance) {
+	i32 width = (i32)buffer->width;
+	i32 height = (i32)buffer->height;
+	u32 p = (y * buffer->width) + (u32)x;
+	__m128 centreColour[4];
+	__m128 centreNormal[4];
+	loadTransposedTuples4(&input[p], &input[p + 1], &input[p + 2], &input[p + 3], centreColour);
+	loadTransposedTuples4(&buffer->normals[p], &buffer->normals[p + 1], &buffer->normals[p + 2], &buffer->normals[p + 3], centreNormal);
+	__m128 centreDepth = _mm_loadu_ps(&buffer->depths[p]);
+	__m128 zero = _mm_setzero_ps();
+
+	// @denpa: Lanes that hit nothing divide by 0 here, but they keep their colour at the end anyway.
+	__m128 inverseDepthScale = _mm_div_ps(_mm_set1_ps(1.f), _mm_mul_ps(centreDepth, _mm_set1_ps(DENOISE_DEPTH_SIGMA * (f32)stepWidth)));
+	__m128 colourVariance = _mm_set1_ps(inverseColourVariance);
+	__m128 weightSum = zero;
+	__m128 colourSum[4] = {zero, zero, zero, zero};
+	for (i32 ky = -2; ky <= 2; ky++) {
+		i32 qy = (i32)y + (ky * stepWidth);
+		if (qy < 0 || qy >= height) {continue;}
+		for (i32 kx = -2; kx <= 2; kx++) {
+			i32 qx = x + (kx * stepWidth);
+			if (qx + 3 < 0 || qx >= width) {continue;}
+
+			u32 q[4];
+			for (i32 i = 0; i < 4; i++) {q[i] = ((u32)qy * buffer->width) + (u32)DENPA_CLAMP(qx + i, 0, width - 1);}
+			__m128 inside = _mm_castsi128_ps(_mm_set_epi32(-(qx + 3 >= 0 && qx + 3 < width), -(qx + 2 >= 0 && qx + 2 < width),
+														   -(qx + 1 >= 0 && qx + 1 < width), -(qx >= 0)));
+			__m128 sampleColour[4];
+			__m128 sampleNormal[4];
+			loadTransposedTuples4(&input[q[0]], &input[q[1]], &input[q[2]], &input[q[3]], sampleColour);
+			loadTransposedTuples4(&buffer->normals[q[0]], &buffer->normals[q[1]], &buffer->normals[q[2]], &buffer->normals[q[3]], sampleNormal);
+			__m128 sampleDepth = _mm_set_ps(buffer->depths[q[3]], buffer->depths[q[2]], buffer->depths[q[1]], buffer->depths[q[0]]);
+
+			__m128 normalDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centreNormal[0], sampleNormal[0]), _mm_mul_ps(centreNormal[1], sampleNormal[1])),
+										  _mm_mul_ps(centreNormal[2], sampleNormal[2]));
+			__m128 normalWeight = normalDot;
+			for (u32 i = 0; i < DENOISE_NORMAL_POWER_SQUARINGS; i++) {normalWeight = _mm_mul_ps(normalWeight, normalWeight);}
+
+			__m128 colourDistance = zero;
+			for (u32 channel = 0; channel < 3; channel++) {
+				__m128 difference = _mm_sub_ps(centreColour[channel], sampleColour[channel]);
+				colourDistance = _mm_add_ps(colourDistance, _mm_mul_ps(difference, difference));
+			}
+			__m128 depthDifference = _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_sub_ps(centreDepth, sampleDepth));
+			__m128 exponent = _mm_add_ps(_mm_mul_ps(colourDistance, colourVariance), _mm_mul_ps(depthDifference, inverseDepthScale));
+
+			__m128 weight = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(denoiseKernel[kx + 2] * denoiseKernel[ky + 2]), fastExp4(_mm_sub_ps(zero, exponent))), normalWeight);
+			weight = _mm_and_ps(weight, _mm_and_ps(inside, _mm_cmpgt_ps(normalDot, zero)));
+			for (u32 channel = 0; channel < 4; channel++) {colourSum[channel] = _mm_add_ps(colourSum[channel], _mm_mul_ps(sampleColour[channel], weight));}
+			weightSum = _mm_add_ps(weightSum, weight);
+		}
+	}
+
+	// @denpa: Pixels that hit nothing or got no weight keep their colour.
+	__m128 keep = _mm_or_ps(_mm_cmple_ps(centreDepth, zero), _mm_cmple_ps(weightSum, zero));
+	__m128 inverseWeightSum = _mm_div_ps(_mm_set1_ps(1.f), weightSum);
+	for (u32 channel = 0; channel < 4; channel++) {
+		__m128 filtered = _mm_mul_ps(colourSum[channel], inverseWeightSum);
+		colourSum[channel] = _mm_or_ps(_mm_and_ps(keep, centreColour[channel]), _mm_andnot_ps(keep, filtered));
+	}
+	_MM_TRANSPOSE4_PS(colourSum[0], colourSum[1], colourSum[2], colourSum[3]);
+	for (u32 i = 0; i < 4; i++) {_mm_storeu_ps(&output[p + i].x, colourSum[i]);}
+}
+#endif
+
+// -----------------------------------------------
+// @denpa: Runs one iteration of the filter over a single row of the image.
+// With SSE2, 4 pixels are filtered at a time and the pixels left at the end of the row one by one.
+// -----------------------------------------------
+INTERNAL DNOINLINE void denoiseRow(frameBuffer* buffer, colour* input, colour* output, u32 y, i32 stepWidth, f32 colourSigma) {
+	i32 width = (i32)buffer->width;
+	f32 inverseColourVariance = 1.f / (colourSigma * colourSigma);
+	i32 x = 0;
+#if DENPA_SIMD_SSE2
+	for (; x + 4 <= width; x += 4) {denoisePixels4(buffer, input, output, y, x, stepWidth, inverseColourVariance);}
+#endif
+	for (; x < width; x++) {denoisePixel(buffer, input, output, y, x, stepWidth, inverseColourVariance);}
+}
+
+// -----------------------------------------------
+// @denpa: The number of bytes denoiseFrameBuffer() needs from the arena.
+// -----------------------------------------------
+INTERNAL DINLINE u64 denoiseMemorySize(u32 width, u32 height) {
+	return (sizeof(colour) * (u64)width * height) + ARENA_DEFAULT_ALIGNMENT;
+}
+
+// -----------------------------------------------
+// @denpa: Denoises the colours of the frame buffer in place, guided by its normals and depths.
+// This must run before clampAndScaleColours() since the filter works on the linear colours.
+// The ping-pong buffer is temporarily taken from the arena, so it needs denoiseMemorySize() bytes to spare.
+// -----------------------------------------------
+INTERNAL DNOINLINE void denoiseFrameBuffer(frameBuffer* buffer, memoryArena* arena, u32 threadCount) {
+	temporaryMemory temporary = beginTemporaryMemory(arena);
+	colour* scratch = PUSH_ARRAY(arena, colour, (u64)buffer->width * buffer->height);
+	colour* input = buffer->pixels;
+	colour* output = scratch;
+	f32 colourSigma = DENOISE_COLOUR_SIGMA;
+
+	for (i32 i = 0; i < DENOISE_ITERATION_COUNT; i++) {
+		i32 stepWidth = 1 << i;
+		parallelFor(buffer->height, threadCount, [&](u32 y, UNUSED u32 threadIndex) {
+			denoiseRow(buffer, input, output, y, stepWidth, colourSigma);
+		});
+		colour* swap = input;
+		input = output;
+		output = swap;
+		colourSigma *= .5f;
+	}
+
+	if (input != buffer->pixels) {memcpy(buffer->pixels, input, sizeof(colour) * buffer->width * buffer->height);}
+	endTemporaryMemory(temporary);
+}
@@ -0,0 +1,271 @@
+//  kernels.hpp
+//  Contains the SIMD kernels that are compiled once per instruction set
+//  This file is included several times by cpu.hpp, which defines KERNEL_NAME, KERNEL_TARGET, KERNEL_LANES, f32xN,
+//  KERNEL_SET1, KERNEL_SQRT, KERNEL_MIN, KERNEL_MAX and KERNEL_HIT_MASK before every include, so it has no include guard
+//  Created by 電波
+
+// -----------------------------------------------
+// @denpa: Loads KERNEL_LANES consecutive floats from an array of the shape set.
+// -----------------------------------------------
+#define KERNEL_LOAD(set, array, base) (*(const f32xN*)&(set)->data[((array) * (set)->paddedCount) + (base)])
+#define KERNEL_ABS(a) KERNEL_MAX((a), KERNEL_SET1(0.f) - (a))
+
+// -----------------------------------------------
+// @denpa: Moves the ray into the object space of KERNEL_LANES shapes starting at base, using the cached inverse transformations.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET void KERNEL_NAME(transformRayLanes)(const shapeSet* set, u64 base, tuple rayOrigin, tuple rayDirection,
+																 f32xN origin[3], f32xN direction[3]) {
+	f32xN originX = KERNEL_SET1(rayOrigin.x), originY = KERNEL_SET1(rayOrigin.y), originZ = KERNEL_SET1(rayOrigin.z);
+	f32xN directionX = KERNEL_SET1(rayDirection.x), directionY = KERNEL_SET1(rayDirection.y), directionZ = KERNEL_SET1(rayDirection.z);
+	for (u32 row = 0; row < 3; row++) {
+		direction[row] = (KERNEL_LOAD(set, (row * 4), base) * directionX) + (KERNEL_LOAD(set, (row * 4) + 1, base) * directionY) +
+						 (KERNEL_LOAD(set, (row * 4) + 2, base) * directionZ);
+		origin[row] = (KERNEL_LOAD(set, (row * 4), base) * originX) + (KERNEL_LOAD(set, (row * 4) + 1, base) * originY) +
+					  (KERNEL_LOAD(set, (row * 4) + 2, base) * originZ) + KERNEL_LOAD(set, (row * 4) + 3, base);
+	}
+}
+
+// -----------------------------------------------
+// @denpa: Intersects the ray with KERNEL_LANES spheres starting at base, the same way findSphereRayIntersections() does.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET void KERNEL_NAME(intersectSphereLanes)(const shapeSet* set, u64 base, tuple rayOrigin, tuple rayDirection,
+																	   f32xN* nearT, f32xN* farT, f32xN* discriminant) {
+	f32xN origin[3], direction[3];
+	KERNEL_NAME(transformRayLanes)(set, base, rayOrigin, rayDirection, origin, direction);
+	f32xN sphereToRayX = origin[0] - KERNEL_LOAD(set, SHAPE_SET_ORIGIN_X, base);
+	f32xN sphereToRayY = origin[1] - KERNEL_LOAD(set, SHAPE_SET_ORIGIN_Y, base);
+	f32xN sphereToRayZ = origin[2] - KERNEL_LOAD(set, SHAPE_SET_ORIGIN_Z, base);
+
+	f32xN a = (direction[0] * direction[0]) + (direction[1] * direction[1]) + (direction[2] * direction[2]);
+	f32xN b = KERNEL_SET1(2.f) * ((direction[0] * sphereToRayX) + (direction[1] * sphereToRayY) + (direction[2] * sphereToRayZ));
+	f32xN c = (sphereToRayX * sphereToRayX) + (sphereToRayY * sphereToRayY) + (sphereToRayZ * sphereToRayZ) - KERNEL_SET1(1.f);
+	*discriminant = (b * b) - (KERNEL_SET1(4.f) * a * c);
+
+	f32xN root = KERNEL_SQRT(KERNEL_MAX(*discriminant, KERNEL_SET1(0.f)));
+	f32xN inverseDenominator = KERNEL_SET1(1.f) / (KERNEL_SET1(2.f) * a);
+	*nearT = (KERNEL_SET1(0.f) - b - root) * inverseDenominator;
+	*farT = (KERNEL_SET1(0.f) - b + root) * inverseDenominator;
+}
+
+// -----------------------------------------------
+// @denpa: Returns the index of the sphere with the closest positive hit below maximumT and writes its t value out.
+// Most lanes miss, so only the lanes with a non-negative discriminant are looked at one by one.
+// -----------------------------------------------
+INTERNAL DNOINLINE KERNEL_TARGET u64 KERNEL_NAME(findClosestSphere)(const shapeSet* set, tuple rayOrigin, tuple rayDirection, f32 maximumT, f32* tOut) {
+	u64 closest = SHAPE_SET_MISS;
+	f32 closestT = maximumT;
+	for (u64 base = 0; base < set->count; base += KERNEL_LANES) {
+		f32xN nearT, farT, discriminant;
+		KERNEL_NAME(intersectSphereLanes)(set, base, rayOrigin, rayDirection, &nearT, &farT, &discriminant);
+		u32 laneCount = (u32)DENPA_MIN((u64)KERNEL_LANES, set->count - base);
+		for (u32 mask = KERNEL_HIT_MASK(discriminant); mask; mask &= mask - 1) {
+			u32 lane = (u32)__builtin_ctz(mask);
+			if (lane >= laneCount) {break;}
+			f32 t = firstPositiveSphereHit(nearT[lane], farT[lane], discriminant[lane]);
+			if (t > 0.f && t < closestT) {
+				closest = base + lane;
+				closestT = t;
+			}
+		}
+	}
+	if (closest != SHAPE_SET_MISS) {*tOut = closestT;}
+	return closest;
+}
+
+// -----------------------------------------------
+// @denpa: Checks if any sphere is hit at a positive t value below maximumT. Used for shadow rays.
+// -----------------------------------------------
+INTERNAL DNOINLINE KERNEL_TARGET bool KERNEL_NAME(isAnySphereHit)(const shapeSet* set, tuple rayOrigin, tuple rayDirection, f32 maximumT) {
+	for (u64 base = 0; base < set->count; base += KERNEL_LANES) {
+		f32xN nearT, farT, discriminant;
+		KERNEL_NAME(intersectSphereLanes)(set, base, rayOrigin, rayDirection, &nearT, &farT, &discriminant);
+		u32 laneCount = (u32)DENPA_MIN((u64)KERNEL_LANES, set->count - base);
+		for (u32 mask = KERNEL_HIT_MASK(discriminant); mask; mask &= mask - 1) {
+			u32 lane = (u32)__builtin_ctz(mask);
+			if (lane >= laneCount) {break;}
+			f32 t = firstPositiveSphereHit(nearT[lane], farT[lane], discriminant[lane]);
+			if (t > 0.f && t < maximumT) {return true;}
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------
+// @denpa: The kernels below return the closest positive t value of every lane, or infinity where the lane misses.
+// They don't branch on the lanes, every candidate hit is computed and the invalid ones are masked out.
+// This one intersects planes, which are y = 0 in object space.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET f32xN KERNEL_NAME(intersectPlaneLanes)(const shapeSet* set, u64 base, tuple rayOrigin, tuple rayDirection) {
+	f32xN origin[3], direction[3];
+	KERNEL_NAME(transformRayLanes)(set, base, rayOrigin, rayDirection, origin, direction);
+	f32xN zero = KERNEL_SET1(0.f);
+	f32xN t = (zero - origin[1]) / direction[1];
+	return ((KERNEL_ABS(direction[1]) >= KERNEL_SET1(EPSILON)) & (t > zero)) ? t : KERNEL_SET1(INFINITY);
+}
+
+// -----------------------------------------------
+// @denpa: Intersects boxes with the slab method. Inside a box the far side is hit.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET f32xN KERNEL_NAME(intersectBoxLanes)(const shapeSet* set, u64 base, tuple rayOrigin, tuple rayDirection) {
+	f32xN origin[3], direction[3];
+	KERNEL_NAME(transformRayLanes)(set, base, rayOrigin, rayDirection, origin, direction);
+	f32xN zero = KERNEL_SET1(0.f);
+	f32xN nearT = KERNEL_SET1(-INFINITY);
+	f32xN farT = KERNEL_SET1(INFINITY);
+	for (u32 axis = 0; axis < 3; axis++) {
+		f32xN inverseDirection = KERNEL_SET1(1.f) / direction[axis];
+		f32xN t0 = (KERNEL_LOAD(set, SHAPE_SET_MINIMUM_X + axis, base) - origin[axis]) * inverseDirection;
+		f32xN t1 = (KERNEL_LOAD(set, SHAPE_SET_MAXIMUM_X + axis, base) - origin[axis]) * inverseDirection;
+		nearT = KERNEL_MAX(nearT, KERNEL_MIN(t0, t1));
+		farT = KERNEL_MIN(farT, KERNEL_MAX(t0, t1));
+	}
+	f32xN t = (nearT > zero) ? nearT : farT;
+	return ((nearT <= farT) & (t > zero)) ? t : KERNEL_SET1(INFINITY);
+}
+
+// -----------------------------------------------
+// @denpa: Masks out the hits on the side of a cylinder or cone that fall outside of its minimum and maximum y.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET f32xN KERNEL_NAME(selectSideHit)(f32xN t, f32xN originY, f32xN directionY, f32xN minimum, f32xN maximum) {
+	f32xN y = originY + (t * directionY);
+	return ((y > minimum) & (y < maximum) & (t > KERNEL_SET1(0.f))) ? t : KERNEL_SET1(INFINITY);
+}
+
+// -----------------------------------------------
+// @denpa: Masks out the hits on the cap at capY that fall outside of the squared radius.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET f32xN KERNEL_NAME(selectCapHit)(f32xN origin[3], f32xN direction[3], f32xN capY, f32xN radiusSquared) {
+	f32xN t = (capY - origin[1]) / direction[1];
+	f32xN x = origin[0] + (t * direction[0]);
+	f32xN z = origin[2] + (t * direction[2]);
+	return ((((x * x) + (z * z)) <= radiusSquared) & (t > KERNEL_SET1(0.f))) ? t : KERNEL_SET1(INFINITY);
+}
+
+// -----------------------------------------------
+// @denpa: Intersects cylinders of radius 1 around the y axis, with the caps when they are closed.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET f32xN KERNEL_NAME(intersectCylinderLanes)(const shapeSet* set, u64 base, tuple rayOrigin, tuple rayDirection) {
+	f32xN origin[3], direction[3];
+	KERNEL_NAME(transformRayLanes)(set, base, rayOrigin, rayDirection, origin, direction);
+	f32xN zero = KERNEL_SET1(0.f);
+	f32xN epsilon = KERNEL_SET1(EPSILON);
+	f32xN miss = KERNEL_SET1(INFINITY);
+	f32xN minimum = KERNEL_LOAD(set, SHAPE_SET_MINIMUM, base);
+	f32xN maximum = KERNEL_LOAD(set, SHAPE_SET_MAXIMUM, base);
+
+	f32xN a = (direction[0] * direction[0]) + (direction[2] * direction[2]);
+	f32xN b = KERNEL_SET1(2.f) * ((origin[0] * direction[0]) + (origin[2] * direction[2]));
+	f32xN c = (origin[0] * origin[0]) + (origin[2] * origin[2]) - KERNEL_SET1(1.f);
+	f32xN discriminant = (b * b) - (KERNEL_SET1(4.f) * a * c);
+	f32xN root = KERNEL_SQRT(KERNEL_MAX(discriminant, zero));
+	f32xN inverseDenominator = KERNEL_SET1(1.f) / (KERNEL_SET1(2.f) * a);
+	f32xN nearT = KERNEL_NAME(selectSideHit)((zero - b - root) * inverseDenominator, origin[1], direction[1], minimum, maximum);
+	f32xN farT = KERNEL_NAME(selectSideHit)((zero - b + root) * inverseDenominator, origin[1], direction[1], minimum, maximum);
+	f32xN t = ((a >= epsilon) & (discriminant >= zero)) ? KERNEL_MIN(nearT, farT) : miss;
+
+	f32xN one = KERNEL_SET1(1.f);
+	f32xN capT = KERNEL_MIN(KERNEL_NAME(selectCapHit)(origin, direction, minimum, one), KERNEL_NAME(selectCapHit)(origin, direction, maximum, one));
+	capT = ((KERNEL_LOAD(set, SHAPE_SET_CLOSED, base) > zero) & (KERNEL_ABS(direction[1]) >= epsilon)) ? capT : miss;
+	return KERNEL_MIN(t, capT);
+}
+
+// -----------------------------------------------
+// @denpa: Intersects double cones around the y axis with their tips at the origin, with the caps when they are closed.
+// When the ray is parallel to one of the halves, the quadratic turns into a linear equation with a single hit.
+// -----------------------------------------------
+INTERNAL DINLINE KERNEL_TARGET f32xN KERNEL_NAME(intersectConeLanes)(const shapeSet* set, u64 base, tuple rayOrigin, tuple rayDirection) {
+	f32xN origin[3], direction[3];
+	KERNEL_NAME(transformRayLanes)(set, base, rayOrigin, rayDirection, origin, direction);
+	f32xN zero = KERNEL_SET1(0.f);
+	f32xN epsilon = KERNEL_SET1(EPSILON);
+	f32xN miss = KERNEL_SET1(INFINITY);
+	f32xN minimum = KERNEL_LOAD(set, SHAPE_SET_MINIMUM, base);
+	f32xN maximum = KERNEL_LOAD(set, SHAPE_SET_MAXIMUM, base);
+
+	f32xN a = (direction[0] * direction[0]) - (direction[1] * direction[1]) + (direction[2] * direction[2]);
+	f32xN b = KERNEL_SET1(2.f) * ((origin[0] * direction[0]) - (origin[1] * direction[1]) + (origin[2] * direction[2]));
+	f32xN c = (origin[0] * origin[0]) - (origin[1] * origin[1]) + (origin[2] * origin[2]);
+	f32xN discriminant = (b * b) - (KERNEL_SET1(4.f) * a * c);
+	f32xN root = KERNEL_SQRT(KERNEL_MAX(discriminant, zero));
+	f32xN inverseDenominator = KERNEL_SET1(1.f) / (KERNEL_SET1(2.f) * a);
+	f32xN nearT = KERNEL_NAME(selectSideHit)((zero - b - root) * inverseDenominator, origin[1], direction[1], minimum, maximum);
+	f32xN farT = KERNEL_NAME(selectSideHit)((zero - b + root) * inverseDenominator, origin[1], direction[1], minimum, maximum);
+	f32xN linearT = KERNEL_NAME(selectSideHit)((zero - c) / (KERNEL_SET1(2.f) * b), origin[1], direction[1], minimum, maximum);
+	f32xN t = ((KERNEL_ABS(a) >= epsilon) & (discriminant >= zero)) ? KERNEL_MIN(nearT, farT) : miss;
+	t = ((KERNEL_ABS(a) < epsilon) & (KERNEL_ABS(b) >= epsilon)) ? linearT : t;
+
+	f32xN capT = KERNEL_MIN(KERNEL_NAME(selectCapHit)(origin, direction, minimum, minimum * minimum),
+							KERNEL_NAME(selectCapHit)(origin, direction, maximum, maximum * maximum));
+	capT = ((KERNEL_LOAD(set, SHAPE_SET_CLOSED, base) > zero) & (KERNEL_ABS(direction[1]) >= epsilon)) ? capT : miss;
+	return KERNEL_MIN(t, capT);
+}
+
+// -----------------------------------------------
+// @denpa: Defines the closest hit and any hit kernels of a shape type on top of its intersect<type>Lanes() kernel.
+// Only the lanes that are closer than the best hit so far are looked at one by one.
+// -----------------------------------------------
+#define KERNEL_SHAPE_QUERIES(type) \
+INTERNAL DNOINLINE KERNEL_TARGET u64 KERNEL_NAME(findClosest##type)(const shapeSet* set, tuple rayOrigin, tuple rayDirection, f32 maximumT, f32* tOut) { \
+	u64 closest = SHAPE_SET_MISS; \
+	f32 closestT = maximumT; \
+	for (u64 base = 0; base < set->count; base += KERNEL_LANES) { \
+		f32xN t = KERNEL_NAME(intersect##type##Lanes)(set, base, rayOrigin, rayDirection); \
+		u32 laneCount = (u32)DENPA_MIN((u64)KERNEL_LANES, set->count - base); \
+		for (u32 mask = KERNEL_HIT_MASK(KERNEL_SET1(closestT) - t); mask; mask &= mask - 1) { \
+			u32 lane = (u32)__builtin_ctz(mask); \
+			if (lane >= laneCount) {break;} \
+			if (t[lane] < closestT) { \
+				closest = base + lane; \
+				closestT = t[lane]; \
+			} \
+		} \
+	} \
+	if (closest != SHAPE_SET_MISS) {*tOut = closestT;} \
+	return closest; \
+} \
+\
+INTERNAL DNOINLINE KERNEL_TARGET bool KERNEL_NAME(isAny##type##Hit)(const shapeSet* set, tuple rayOrigin, tuple rayDirection, f32 maximumT) { \
+	for (u64 base = 0; base < set->count; base += KERNEL_LANES) { \
+		f32xN t = KERNEL_NAME(intersect##type##Lanes)(set, base, rayOrigin, rayDirection); \
+		u32 laneCount = (u32)DENPA_MIN((u64)KERNEL_LANES, set->count - base); \
+		for (u32 mask = KERNEL_HIT_MASK(KERNEL_SET1(maximumT) - t); mask; mask &= mask - 1) { \
+			u32 lane = (u32)__builtin_ctz(mask); \
+			if (lane >= laneCount) {break;} \
+			if (t[lane] < maximumT) {return true;} \
+		} \
+	} \
+	return false; \
+}
+
+KERNEL_SHAPE_QUERIES(Plane)
+KERNEL_SHAPE_QUERIES(Box)
+KERNEL_SHAPE_QUERIES(Cylinder)
+KERNEL_SHAPE_QUERIES(Cone)
+
+// -----------------------------------------------
+// @denpa: Same as clampAndScaleColours(), but works on KERNEL_LANES floats at a time.
+// The alpha lanes are given infinite bounds so that they only get scaled, like in the scalar version.
+// -----------------------------------------------
+INTERNAL DNOINLINE KERNEL_TARGET void KERNEL_NAME(clampAndScaleColours)(colour* pixels, u64 pixelCount) {
+	f32xN low = KERNEL_SET1(0.f);
+	f32xN high = KERNEL_SET1(1.f);
+	for (u32 lane = 3; lane < KERNEL_LANES; lane += 4) {
+		low[lane] = -INFINITY;
+		high[lane] = INFINITY;
+	}
+
+	f32* values = (f32*)pixels;
+	u64 valueCount = pixelCount * 4;
+	u64 i = 0;
+	for (; i + KERNEL_LANES <= valueCount; i += KERNEL_LANES) {
+		f32xN value;
+		memcpy(&value, &values[i], sizeof(value));
+		value = KERNEL_MIN(KERNEL_MAX(value, low), high) * KERNEL_SET1(255.f);
+		memcpy(&values[i], &value, sizeof(value));
+	}
+	clampAndScaleColours(&pixels[i / 4], pixelCount - (i / 4), 1);
+}
+
+#undef KERNEL_LOAD
+#undef KERNEL_ABS
+#undef KERNEL_SHAPE_QUERIES
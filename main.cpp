@@ -4,52 +4,61 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cctype>
 #include "common.hpp"
 #include "tuple.hpp"
 #include "matrix.hpp"
+#include "sampling.hpp"
+#include "cpu.hpp"
 #include "tracer.hpp"
 #include "miscellaneous.hpp"
+#include "memory.hpp"
+#include "texture.hpp"
+#include "culling.hpp"
+#include "renderer.hpp"
+#include "denoiser.hpp"
+#include "scene.hpp"
+#include "progressive.hpp"
+#include "deadline.hpp"
 #include "debug.hpp"
 
 // -----------------------------------------------
 // @denpa: The main function, where the magic happens.
 // -----------------------------------------------
-int main(UNUSED int argc, UNUSED const char** argv) {
-	f32 wallZ = 10.f;
-	f32 wallSize = 7.f;
-	f32 half = wallSize/2.f;
-	u32 canvasX = 1000;
-	u32 canvasY = canvasX;
-	colour* pixels = (colour*)safeMalloc(sizeof(colour) * canvasX * canvasY);
-	f32 pixelSize = wallSize/canvasX;
+int main(int argc, const char** argv) {
+	renderSettings settings = parseRenderSettings(argc, argv);
+	selectKernels(settings.instructionSet);
+	camera camera = {};
+	u64 passMemorySize = DENPA_MAX(settings.denoise ? denoiseMemorySize(settings.canvasX, settings.canvasY) : 0, settings.progressive ? progressiveMemorySize(settings.canvasX, settings.canvasY) : 0);
+	passMemorySize = DENPA_MAX(passMemorySize, settings.deadline ? deadlineMemorySize(&settings) : 0);
+	u64 frameMemorySize = frameBufferMemorySize(settings.canvasX, settings.canvasY) + passMemorySize + namedSceneMemorySize();
+	memory.frame = createArena("frame", frameMemorySize, true);
+	frameBuffer buffer = createFrameBuffer(&memory.frame, settings.canvasX, settings.canvasY);
+	textures.cacheSize = settings.textureCacheSize;
+	textures.threadCount = settings.threadCount;
+	world world = createNamedScene(&memory.frame, &settings);
 	
-	pointLight pointLight = {.intensity = createColour(1.f, 1.f, 1.f, 1.f), .position = createPoint(-10.f, 10.f, -10.f)};
-	
-	ray ray = {createPoint(0.f, 0.f, -5.f), createVector(0.f, 0.f, 1.f)};
-	sphere sphere = createSphere();
-	sphere.material.surfaceColour = createColour(1.f, .2f, 1.f, 1.f);
-	
-	for (u32 y = 0; y < canvasY; y++) {
-		f32 worldY = half - (pixelSize*y);
-		for (u32 x = 0; x < canvasX; x++) {
-			f32 worldX = -half + (pixelSize * x);
-			point position = createPoint(worldX, worldY, wallZ);
-			ray.rayDirection = normalizeTuple(subtractTuples(position, ray.rayOrigin));
-			intersection result = findRayHits(findSphereRayIntersections(&sphere, ray));
-			
-			if (result.object != NULL) {
-				point intersectionPoint = findRayPosition(ray.rayOrigin, ray.rayDirection, result.t);
-				vector normal = findNormalAt(&sphere, intersectionPoint);
-				vector eye = negateTuple(ray.rayDirection);
-				pixels[y * canvasY + x] = phongLighting(sphere.material, pointLight, intersectionPoint, eye, normal);
-			}
-		}
+	if (settings.deadline) {
+		renderDeadlineImage(&world, &camera, &settings, &buffer, &memory.frame);
+	} else if (settings.progressive) {
+		renderProgressiveImage(&world, &camera, &settings, &buffer, &memory.frame, "denpa.ppm");
+	} else {
+		renderImage(&world, &camera, &settings, &buffer, &memory.frame);
 	}
-	
-	clampAndScaleColours(pixels, canvasX, canvasY);
-	createPPMFile("denpa.ppm", canvasX, canvasY, pixels);
-	free(pixels);
+	createBinaryPPMFile("denpa.ppm", settings.canvasX, settings.canvasY, buffer.pixels);
+	if (settings.printMemoryStatistics) {
+		printMemoryStatistics();
+		printTextureCacheStatistics();
+	}
+	destroyTextures();
+	destroyMemorySystem();
 	
 	return EXIT_SUCCESS;
 }
@@ -237,11 +237,12 @@ INTERNAL DINLINE matrix4x4 transposeMatrix4x4(matrix4x4 a) {
 // -----------------------------------------------
 // @denpa: Finds the inverse of a 4x4 matrix.
 // j is used as the row in cofactorOf4x4 in order to transpose the matrix.
+// The determinant of a scaling is the cube of the scale, so only an exactly singular matrix has no inverse.
 // -----------------------------------------------
 INTERNAL DINLINE matrix4x4 inverseMatrix4x4(matrix4x4 a) {
 	f32 determinant = determinant4x4(a);
 	
-	if (areFloatsEqual(determinant, 0.f)) {return matrix4x4 {};}
+	if (determinant == 0.f) {return matrix4x4 {};}
 	
 	matrix4x4 result;
 	for (u32 i = 0, j = 0; i < 16; i+= 4, j++) {
@@ -0,0 +1,246 @@
+//  memory.hpp
+//  Contains the memory arenas used instead of calling malloc all over the place
+//  Created by 電波
+
+#pragma once
+
+#if DENPA_PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "advapi32.lib")
+#else
+#include <sys/mman.h>
+#endif
+
+// -----------------------------------------------
+// @denpa: A linear allocator. Allocating just bumps the used counter and everything is freed at once by resetting it.
+// The peak is kept across resets so that the statistics show the most memory the arena ever needed.
+// -----------------------------------------------
+typedef struct memoryArena {
+	u8* base = NULL;
+	u64 size = 0;
+	u64 used = 0;
+	u64 peak = 0;
+	const char* name = "";
+	bool largePages = false;
+} memoryArena;
+
+// -----------------------------------------------
+// @denpa: Remembers how much of the arena was used so that temporary allocations can be thrown away later.
+// -----------------------------------------------
+typedef struct temporaryMemory {
+	memoryArena* arena = NULL;
+	u64 used = 0;
+} temporaryMemory;
+
+// -----------------------------------------------
+// @denpa: The arena for everything that lives as long as the frame, like the frame buffer and the scene,
+// one scratch arena per worker thread that gets reset between tiles, the arena of the texture cache,
+// and the arena of the screen space bins, which is rebuilt every frame.
+// -----------------------------------------------
+typedef struct memorySystem {
+	memoryArena frame = {};
+	memoryArena scratch[MAX_THREAD_COUNT] = {};
+	memoryArena textures = {};
+	memoryArena culling = {};
+} memorySystem;
+
+GLOBAL_VARIABLE memorySystem memory = {};
+
+#define SCRATCH_ARENA_SIZE DENPA_MEGABYTES(16)
+#define LARGE_PAGE_SIZE DENPA_MEGABYTES(2)
+#define ARENA_DEFAULT_ALIGNMENT 64
+
+#define PUSH_STRUCT(arena, type) ((type*)pushSize((arena), sizeof(type), alignof(type)))
+#define PUSH_ARRAY(arena, type, count) ((type*)pushSize((arena), sizeof(type) * (count), ARENA_DEFAULT_ALIGNMENT))
+
+#if DENPA_PLATFORM_WINDOWS
+// -----------------------------------------------
+// @denpa: Large pages on Windows need the SeLockMemoryPrivilege, which has to be granted to the user beforehand.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool enableLargePagePrivilege(void) {
+	HANDLE token = NULL;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {return false;}
+
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool result = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+				  AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+				  GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	return result;
+}
+#endif
+
+// -----------------------------------------------
+// @denpa: Gets zeroed memory straight from the OS.
+// When large pages are asked for, they are tried first and regular pages are used if that fails.
+// The size is rounded up to the page size that ended up being used.
+// -----------------------------------------------
+INTERNAL DNOINLINE void* allocatePages(u64* size, bool* largePages) {
+	void* data = NULL;
+#if DENPA_PLATFORM_WINDOWS
+	if (*largePages) {
+		LOCAL_PERSIST bool privilegeEnabled = enableLargePagePrivilege();
+		u64 largePageSize = GetLargePageMinimum();
+		if (privilegeEnabled && largePageSize) {
+			u64 roundedSize = ((*size + largePageSize - 1) / largePageSize) * largePageSize;
+			data = VirtualAlloc(NULL, roundedSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (data) {*size = roundedSize; return data;}
+		}
+		*largePages = false;
+	}
+	data = VirtualAlloc(NULL, *size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	if (*largePages) {
+		*size = ((*size + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE) * LARGE_PAGE_SIZE;
+#if defined(MAP_HUGETLB)
+		data = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (data != MAP_FAILED) {return data;}
+#endif
+	}
+	data = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) {data = NULL;}
+#if defined(MADV_HUGEPAGE)
+	// @denpa: Without reserved huge pages, transparent huge pages are the next best thing.
+	if (data && *largePages) {*largePages = madvise(data, *size, MADV_HUGEPAGE) == 0;}
+#else
+	*largePages = false;
+#endif
+#endif
+	if (!data) {
+		printf("allocatePages() failed with size: %llu\n", (unsigned long long)*size);
+		exit(EXIT_FAILURE);
+	}
+	return data;
+}
+
+// -----------------------------------------------
+// @denpa: Gives the pages back to the OS.
+// -----------------------------------------------
+INTERNAL DNOINLINE void freePages(void* data, UNUSED u64 size) {
+#if DENPA_PLATFORM_WINDOWS
+	VirtualFree(data, 0, MEM_RELEASE);
+#else
+	munmap(data, size);
+#endif
+}
+
+// -----------------------------------------------
+// @denpa: Creates an arena that can hold up to size bytes.
+// -----------------------------------------------
+INTERNAL DNOINLINE memoryArena createArena(const char* name, u64 size, bool largePages) {
+	memoryArena arena = {.size = size, .name = name, .largePages = largePages};
+	arena.base = (u8*)allocatePages(&arena.size, &arena.largePages);
+	return arena;
+}
+
+// -----------------------------------------------
+// @denpa: Frees the memory of the arena. The arena has to be created again before it can be used.
+// -----------------------------------------------
+INTERNAL DNOINLINE void destroyArena(memoryArena* arena) {
+	if (arena->base) {freePages(arena->base, arena->size);}
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
+
+// -----------------------------------------------
+// @denpa: Allocates memory from the arena. Running out of memory is treated the same way as malloc failing.
+// The memory is not cleared.
+// -----------------------------------------------
+INTERNAL DINLINE void* pushSize(memoryArena* arena, u64 size, u64 alignment) {
+	u64 address = (u64)(arena->base + arena->used);
+	u64 padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+	if (arena->used + padding + size > arena->size) {
+		printf("pushSize() ran out of memory in the %s arena. Size: %llu, used: %llu, capacity: %llu\n", arena->name,
+			   (unsigned long long)size, (unsigned long long)arena->used, (unsigned long long)arena->size);
+		exit(EXIT_FAILURE);
+	}
+	void* result = arena->base + arena->used + padding;
+	arena->used += padding + size;
+	arena->peak = DENPA_MAX(arena->peak, arena->used);
+	return result;
+}
+
+// -----------------------------------------------
+// @denpa: Frees everything allocated from the arena.
+// -----------------------------------------------
+INTERNAL DINLINE void resetArena(memoryArena* arena) {
+	arena->used = 0;
+}
+
+// -----------------------------------------------
+// @denpa: Everything allocated between beginTemporaryMemory() and endTemporaryMemory() is freed by the latter.
+// -----------------------------------------------
+INTERNAL DINLINE temporaryMemory beginTemporaryMemory(memoryArena* arena) {
+	return temporaryMemory {.arena = arena, .used = arena->used};
+}
+
+INTERNAL DINLINE void endTemporaryMemory(temporaryMemory temporary) {
+	temporary.arena->used = temporary.used;
+}
+
+// -----------------------------------------------
+// @denpa: Returns the scratch arena of a worker thread, creating it the first time it is asked for.
+// Every thread index is only ever used by one thread at a time, so this doesn't need to be synchronized.
+// -----------------------------------------------
+INTERNAL DINLINE memoryArena* getScratchArena(u32 threadIndex) {
+	memoryArena* arena = &memory.scratch[threadIndex];
+	if (!arena->base) {*arena = createArena("scratch", SCRATCH_ARENA_SIZE, false);}
+	return arena;
+}
+
+// -----------------------------------------------
+// @denpa: Prints the peak usage of an arena.
+// -----------------------------------------------
+INTERNAL DNOINLINE void printArenaStatistics(memoryArena* arena) {
+	printf("%-12s peak %10.3f MB / %10.3f MB%s\n", arena->name,
+		   (double)arena->peak / (double)DENPA_MEGABYTES(1), (double)arena->size / (double)DENPA_MEGABYTES(1),
+		   arena->largePages ? " (large pages)" : "");
+}
+
+// -----------------------------------------------
+// @denpa: Prints the peak usage of every arena that was used.
+// -----------------------------------------------
+INTERNAL DNOINLINE void printMemoryStatistics(void) {
+	if (memory.frame.base) {printArenaStatistics(&memory.frame);}
+	for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {
+		if (!memory.scratch[i].base) {continue;}
+		printf("[%3u] ", i);
+		printArenaStatistics(&memory.scratch[i]);
+	}
+	if (memory.textures.base) {printArenaStatistics(&memory.textures);}
+	if (memory.culling.base) {printArenaStatistics(&memory.culling);}
+}
+
+// -----------------------------------------------
+// @denpa: Returns the sum of the peaks of every arena that was used.
+// -----------------------------------------------
+INTERNAL DNOINLINE u64 totalPeakMemory(void) {
+	u64 total = memory.frame.peak;
+	for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {total += memory.scratch[i].peak;}
+	return total + memory.textures.peak + memory.culling.peak;
+}
+
+// -----------------------------------------------
+// @denpa: Clears the peaks of every arena, so that the next measurement starts from what is currently used.
+// -----------------------------------------------
+INTERNAL DNOINLINE void resetMemoryStatistics(void) {
+	memory.frame.peak = memory.frame.used;
+	for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {memory.scratch[i].peak = memory.scratch[i].used;}
+	memory.textures.peak = memory.textures.used;
+	memory.culling.peak = memory.culling.used;
+}
+
+// -----------------------------------------------
+// @denpa: Frees all the arenas.
+// -----------------------------------------------
+INTERNAL DNOINLINE void destroyMemorySystem(void) {
+	destroyArena(&memory.frame);
+	for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {destroyArena(&memory.scratch[i]);}
+	destroyArena(&memory.textures);
+	destroyArena(&memory.culling);
+}
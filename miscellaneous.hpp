@@ -4,10 +4,17 @@
 
 #pragma once
 
+#if DENPA_PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
 // -----------------------------------------------
 // @denpa: A safer version of malloc.
+// Prefer allocating from one of the arenas in memory.hpp.
 // -----------------------------------------------
-INTERNAL DNOINLINE void* safeMalloc(size_t structSize) {
+INTERNAL DNOINLINE UNUSED void* safeMalloc(size_t structSize) {
 	void* data = malloc(structSize);
 	if (!data) {
 		printf("safeMalloc() failed with structSize: %lu", structSize);
@@ -16,11 +23,61 @@ INTERNAL DNOINLINE void* safeMalloc(size_t structSize) {
 	return data;
 }
 
+// -----------------------------------------------
+// @denpa: Upper limit for the number of worker threads.
+// -----------------------------------------------
+#define MAX_THREAD_COUNT 256u
+
+// -----------------------------------------------
+// @denpa: Turns a requested thread count into the real one. 0 means one thread per hardware thread.
+// -----------------------------------------------
+INTERNAL DINLINE u32 resolveThreadCount(u32 requested) {
+	u32 threadCount = requested ? requested : DENPA_MAX(std::thread::hardware_concurrency(), 1u);
+	return DENPA_MIN(threadCount, MAX_THREAD_COUNT);
+}
+
+// -----------------------------------------------
+// @denpa: Runs job(jobIndex, threadIndex) for every job index in [0, jobCount) on up to threadCount threads.
+// Threads grab the next job from a shared counter, so the order in which jobs run is not fixed.
+// -----------------------------------------------
+template <typename function>
+INTERNAL DNOINLINE void parallelFor(u32 jobCount, u32 threadCount, function job) {
+	threadCount = DENPA_MIN(resolveThreadCount(threadCount), jobCount);
+	std::atomic<u32> nextJob = 0;
+
+	auto worker = [&](u32 threadIndex) {
+		for (u32 i = nextJob++; i < jobCount; i = nextJob++) {job(i, threadIndex);}
+	};
+
+	std::thread threads[MAX_THREAD_COUNT];
+	for (u32 i = 0; i < threadCount; i++) {threads[i] = std::thread(worker, i);}
+	for (u32 i = 0; i < threadCount; i++) {threads[i].join();}
+}
+
+// -----------------------------------------------
+// @denpa: Returns the time in seconds from a monotonic clock. Only the difference between two calls means anything.
+// -----------------------------------------------
+INTERNAL DINLINE UNUSED f64 getWallClockSeconds(void) {
+	return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// -----------------------------------------------
+// @denpa: Moves the temporary file over the file, replacing it in one step so that nothing ever sees a half-written file.
+// rename() refuses to replace an existing file on Windows, so MoveFileEx() is used there instead.
+// -----------------------------------------------
+INTERNAL DNOINLINE void replaceFile(const char* temporaryFileName, const char* fileName) {
+#if DENPA_PLATFORM_WINDOWS
+	if (!MoveFileExA(temporaryFileName, fileName, MOVEFILE_REPLACE_EXISTING)) {printf("MoveFileExA() in replaceFile() failed for %s.\n", fileName);}
+#else
+	if (rename(temporaryFileName, fileName) != 0) {perror("rename() in replaceFile() failed.");}
+#endif
+}
+
 // -----------------------------------------------
 // @denpa: Uses the provided colour data to create a .ppm file.
 // This function does not fully follow the ppm specification.
 // -----------------------------------------------
-INTERNAL DNOINLINE void createPPMFile(const char* fileName, u32 x, u32 y, colour* pixels) {
+INTERNAL DNOINLINE UNUSED void createPPMFile(const char* fileName, u32 x, u32 y, colour* pixels) {
 	FILE* output = fopen(fileName, "wb");
 	if (!output) {perror("fopen() in createPPMFile() failed."); return;}
 	fprintf(output, "P3\n%d %d\n255\n", x, y);
@@ -29,3 +86,22 @@ INTERNAL DNOINLINE void createPPMFile(const char* fileName, u32 x, u32 y, colour
 	}
 	fclose(output);
 }
+
+// -----------------------------------------------
+// @denpa: Same as createPPMFile(), but writes the binary version of the format, which is about a quarter of the size.
+// The image is written to a temporary file next to the file first and then moved into place with replaceFile(),
+// so a viewer watching the file, for example while the progressive renderer keeps rewriting it, only ever sees whole images.
+// -----------------------------------------------
+INTERNAL DNOINLINE UNUSED void createBinaryPPMFile(const char* fileName, u32 x, u32 y, colour* pixels) {
+	char temporaryFileName[1024] = {};
+	snprintf(temporaryFileName, sizeof(temporaryFileName), "%s.tmp", fileName);
+	FILE* output = fopen(temporaryFileName, "wb");
+	if (!output) {perror("fopen() in createBinaryPPMFile() failed."); return;}
+	fprintf(output, "P6\n%d %d\n255\n", x, y);
+	for (u32 i = 0; i < (x*y); i++) {
+		u8 rgb[3] = {(u8)((pixels+i)->r), (u8)((pixels+i)->g), (u8)((pixels+i)->b)};
+		fwrite(rgb, sizeof(rgb), 1, output);
+	}
+	fclose(output);
+	replaceFile(temporaryFileName, fileName);
+}
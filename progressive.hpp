@@ -0,0 +1,187 @@
+//  progressive.hpp
+//  Contains the progressive renderer, which writes out a rough preview right away and keeps refining it pass after pass
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: The order in which the pixels of every 4 by 4 block get their first sample, which is a 4 by 4 Bayer matrix.
+// The first pass traces the pixels ranked 0, so 1/16 of the image, the second pass the ones ranked below 4,
+// which completes a 1/4 resolution image, and the third pass everything else.
+// After that every pass doubles the number of samples per pixel.
+// -----------------------------------------------
+#define PROGRESSIVE_BLOCK_SIZE 4
+#define PROGRESSIVE_PIXEL_PASS_COUNT 3
+GLOBAL_VARIABLE const u8 progressivePixelRanks[PROGRESSIVE_BLOCK_SIZE][PROGRESSIVE_BLOCK_SIZE] = {
+	{0, 8, 2, 10},
+	{12, 4, 14, 6},
+	{3, 11, 1, 9},
+	{15, 7, 13, 5},
+};
+GLOBAL_VARIABLE const u32 progressivePixelPassRanks[PROGRESSIVE_PIXEL_PASS_COUNT] = {1, 4, PROGRESSIVE_BLOCK_SIZE * PROGRESSIVE_BLOCK_SIZE};
+
+// -----------------------------------------------
+// @denpa: The running sums of every pixel, kept across the passes so that no sample is ever traced twice.
+// -----------------------------------------------
+typedef struct progressiveBuffer {
+	colour* colours = NULL;
+	vector* normals = NULL;
+	f32* depths = NULL;
+	u32* sampleCounts = NULL;
+	u32* hitCounts = NULL;
+} progressiveBuffer;
+
+// -----------------------------------------------
+// @denpa: The number of bytes renderProgressiveImage() needs from the arena, padding for alignment included.
+// -----------------------------------------------
+INTERNAL DINLINE u64 progressiveMemorySize(u32 width, u32 height) {
+	u64 pixelCount = (u64)width * height;
+	return ((sizeof(colour) + sizeof(vector) + sizeof(f32) + (2 * sizeof(u32))) * pixelCount) + (5 * ARENA_DEFAULT_ALIGNMENT);
+}
+
+// -----------------------------------------------
+// @denpa: Brings every pixel of the rectangle with a rank below rankCount up to sampleTarget samples.
+// The samples are added in the same order as in renderTile(), so the finished image is the same as the one renderFrame() makes.
+// Tiles are culled with the screen space bins the same way renderTile() does it.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics refineTile(world* world, camera* camera, renderSettings* settings, progressiveBuffer* accumulation, memoryArena* scratch,
+											   screenBins* bins, u32 rankCount, u32 sampleTarget, u32 startX, u32 startY, u32 endX, u32 endY) {
+	u64 sampleCount = 0;
+	u64 hitCount = 0;
+	u64 tile = bins ? getPixelTile(bins, startX, startY) : 0;
+	bool empty = bins && isTileEmpty(bins, tile);
+	temporaryMemory temporary = beginTemporaryMemory(scratch);
+	tileCandidates candidates = {};
+	tileCandidates* tileShapes = NULL;
+	if (bins && !empty && gatherTileCandidates(bins, world, tile, scratch, &candidates)) {tileShapes = &candidates;}
+
+	for (u32 y = startY; y < endY; y++) {
+		for (u32 x = startX; x < endX; x++) {
+			if (progressivePixelRanks[y % PROGRESSIVE_BLOCK_SIZE][x % PROGRESSIVE_BLOCK_SIZE] >= rankCount) {continue;}
+			u32 pixelIndex = (y * settings->canvasX) + x;
+			u32 s = empty ? DENPA_MAX(accumulation->sampleCounts[pixelIndex], sampleTarget) : accumulation->sampleCounts[pixelIndex];
+			for (; s < sampleTarget; s++) {
+				vector normal = createVector(0.f, 0.f, 0.f);
+				f32 depth = 0.f;
+				colour sampleColour = tracePixelSample(world, tileShapes, camera, settings, x, y, s, &normal, &depth);
+				accumulation->colours[pixelIndex] = addTuples(accumulation->colours[pixelIndex], sampleColour);
+				accumulation->normals[pixelIndex] = addTuples(accumulation->normals[pixelIndex], normal);
+				accumulation->depths[pixelIndex] += depth;
+				accumulation->hitCounts[pixelIndex] += (depth > 0.f);
+				hitCount += (depth > 0.f);
+				sampleCount++;
+			}
+			accumulation->sampleCounts[pixelIndex] = s;
+		}
+	}
+	endTemporaryMemory(temporary);
+	return renderStatistics {.cameraRays = sampleCount, .shadowRays = hitCount * world->lightCount};
+}
+
+// -----------------------------------------------
+// @denpa: Averages the running sums of a row into the frame buffer.
+// Pixels without samples yet are copied from the pixel at the corner of their 2 by 2 block if it has been traced,
+// or else from the one at the corner of their 4 by 4 block, which is always traced in the first pass.
+// Depths and normals are averaged over the samples that hit something, like in renderTile().
+// -----------------------------------------------
+INTERNAL DNOINLINE void resolveProgressiveRow(progressiveBuffer* accumulation, frameBuffer* buffer, u32 y) {
+	for (u32 x = 0; x < buffer->width; x++) {
+		u32 pixelIndex = (y * buffer->width) + x;
+		u32 source = pixelIndex;
+		if (accumulation->sampleCounts[source] == 0) {source = ((y & ~1u) * buffer->width) + (x & ~1u);}
+		if (accumulation->sampleCounts[source] == 0) {source = ((y & ~3u) * buffer->width) + (x & ~3u);}
+
+		f32 inverseSampleCount = 1.f / (f32)accumulation->sampleCounts[source];
+		u32 hits = accumulation->hitCounts[source];
+		buffer->pixels[pixelIndex] = scaleTuple(accumulation->colours[source], inverseSampleCount);
+		buffer->normals[pixelIndex] = hits ? normalizeTuple(accumulation->normals[source]) : accumulation->normals[source];
+		buffer->depths[pixelIndex] = hits ? accumulation->depths[source] / (f32)hits : 0.f;
+	}
+}
+
+// -----------------------------------------------
+// @denpa: Renders the world pass by pass, and writes the image to previewFileName after every pass but the last one.
+// Stops once every pixel has samplesPerPixel samples, or when the next pass is not expected to fit in the time budget.
+// The frame buffer is then ready to be written out, just like after renderImage().
+// The arena needs progressiveMemorySize() bytes to spare, which are given back before denoising.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics renderProgressiveImage(world* world, camera* camera, renderSettings* settings, frameBuffer* buffer,
+														   memoryArena* arena, const char* previewFileName) {
+	f64 startTime = getWallClockSeconds();
+	u64 pixelCount = (u64)settings->canvasX * settings->canvasY;
+	temporaryMemory temporary = beginTemporaryMemory(arena);
+	progressiveBuffer accumulation = {.colours = PUSH_ARRAY(arena, colour, pixelCount),
+									  .normals = PUSH_ARRAY(arena, vector, pixelCount),
+									  .depths = PUSH_ARRAY(arena, f32, pixelCount),
+									  .sampleCounts = PUSH_ARRAY(arena, u32, pixelCount),
+									  .hitCounts = PUSH_ARRAY(arena, u32, pixelCount)};
+	for (u64 i = 0; i < pixelCount; i++) {
+		accumulation.colours[i] = createColour(0.f, 0.f, 0.f, 0.f);
+		accumulation.normals[i] = createVector(0.f, 0.f, 0.f);
+		accumulation.depths[i] = 0.f;
+		accumulation.sampleCounts[i] = 0;
+		accumulation.hitCounts[i] = 0;
+	}
+
+	u32 tilesX = (settings->canvasX + settings->tileSize - 1) / settings->tileSize;
+	u32 tilesY = (settings->canvasY + settings->tileSize - 1) / settings->tileSize;
+	renderStatistics statistics = {};
+	u32 samplesPerPixel = 0;
+	screenBins binStorage = {};
+	screenBins* bins = prepareScreenBins(world, camera, settings, &binStorage);
+
+	for (u32 pass = 0;; pass++) {
+		bool pixelPass = pass < PROGRESSIVE_PIXEL_PASS_COUNT;
+		u32 rankCount = pixelPass ? progressivePixelPassRanks[pass] : (PROGRESSIVE_BLOCK_SIZE * PROGRESSIVE_BLOCK_SIZE);
+		u32 sampleTarget = pixelPass ? 1 : DENPA_MIN(samplesPerPixel * 2, settings->samplesPerPixel);
+		f64 passStartTime = getWallClockSeconds();
+
+		renderStatistics threadStatistics[MAX_THREAD_COUNT] = {};
+		parallelFor(tilesX * tilesY, settings->threadCount, [&](u32 tile, u32 threadIndex) {
+			u32 startX = (tile % tilesX) * settings->tileSize;
+			u32 startY = (tile / tilesX) * settings->tileSize;
+			u32 endX = DENPA_MIN(startX + settings->tileSize, settings->canvasX);
+			u32 endY = DENPA_MIN(startY + settings->tileSize, settings->canvasY);
+			renderStatistics tileStatistics = refineTile(world, camera, settings, &accumulation, getScratchArena(threadIndex), bins,
+														 rankCount, sampleTarget, startX, startY, endX, endY);
+			threadStatistics[threadIndex].cameraRays += tileStatistics.cameraRays;
+			threadStatistics[threadIndex].shadowRays += tileStatistics.shadowRays;
+		});
+
+		u64 passSampleCount = 0;
+		for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {
+			passSampleCount += threadStatistics[i].cameraRays;
+			statistics.cameraRays += threadStatistics[i].cameraRays;
+			statistics.shadowRays += threadStatistics[i].shadowRays;
+		}
+		if (rankCount == PROGRESSIVE_BLOCK_SIZE * PROGRESSIVE_BLOCK_SIZE) {samplesPerPixel = sampleTarget;}
+
+		f64 now = getWallClockSeconds();
+		printf("Pass %u: %5.1f%% of the pixels with %u samples per pixel, %.1f ms\n", pass + 1,
+			   100.0 * rankCount / (PROGRESSIVE_BLOCK_SIZE * PROGRESSIVE_BLOCK_SIZE), sampleTarget, (now - startTime) * 1000.0);
+		if (samplesPerPixel >= settings->samplesPerPixel) {break;}
+
+		// @denpa: The next pass is estimated from the time this one took per sample.
+		if (settings->timeBudget) {
+			u64 nextSampleCount = pixelCount * (DENPA_MIN(samplesPerPixel * 2, settings->samplesPerPixel) - samplesPerPixel);
+			if (pass + 1 < PROGRESSIVE_PIXEL_PASS_COUNT) {
+				nextSampleCount = pixelCount * (progressivePixelPassRanks[pass + 1] - rankCount) / (PROGRESSIVE_BLOCK_SIZE * PROGRESSIVE_BLOCK_SIZE);
+			}
+			f64 nextPassTime = (now - passStartTime) * (f64)nextSampleCount / (f64)DENPA_MAX(passSampleCount, 1ull);
+			if ((now - startTime + nextPassTime) * 1000.0 > (f64)settings->timeBudget) {break;}
+		}
+
+		parallelFor(settings->canvasY, settings->threadCount, [&](u32 y, UNUSED u32 threadIndex) {
+			resolveProgressiveRow(&accumulation, buffer, y);
+		});
+		kernels.clampAndScaleColours(buffer->pixels, pixelCount);
+		createBinaryPPMFile(previewFileName, settings->canvasX, settings->canvasY, buffer->pixels);
+	}
+
+	parallelFor(settings->canvasY, settings->threadCount, [&](u32 y, UNUSED u32 threadIndex) {
+		resolveProgressiveRow(&accumulation, buffer, y);
+	});
+	endTemporaryMemory(temporary);
+	finishImage(settings, buffer, arena);
+	return statistics;
+}
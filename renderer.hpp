@@ -0,0 +1,309 @@
+//  renderer.hpp
+//  Contains the camera, the render settings and the multithreaded tile renderer
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: The camera shoots rays from its origin through a wall of the given size placed at wallZ.
+// -----------------------------------------------
+typedef struct camera {
+	point origin = createPoint(0.f, 0.f, -5.f);
+	f32 wallZ = 10.f;
+	f32 wallSize = 7.f;
+} camera;
+
+// -----------------------------------------------
+// @denpa: Everything that controls how a frame gets rendered.
+// A threadCount of 0 means one thread per hardware thread.
+// In progressive mode the image is refined over several passes until samplesPerPixel or the time budget is reached,
+// a timeBudget of 0 means there is no time limit. The time budget is given in milliseconds.
+// In deadline mode the frame has to be done within deadline milliseconds, and samplesPerPixel, shading and resolutionScale
+// are lowered tile by tile to get there. A resolutionScale of n traces every n by n block once, at its centre.
+// Deadline mode takes over progressive mode when both are asked for.
+// With cull set, camera rays are only tested against the shapes whose screen space bounds overlap their tile.
+// The textures scene puts the image in textureFileName on its sphere, and the texture cache is given in megabytes on the command line.
+// -----------------------------------------------
+typedef struct renderSettings {
+	u32 canvasX = 1000;
+	u32 canvasY = 1000;
+	u32 samplesPerPixel = 16;
+	u32 threadCount = 0;
+	u32 tileSize = 32;
+	u32 seed = 0;
+	u32 timeBudget = 0;
+	u32 deadline = 0;
+	u32 resolutionScale = 1;
+	shadingQuality shading = SHADING_FULL;
+	bool progressive = false;
+	bool denoise = false;
+	bool cull = true;
+	bool printMemoryStatistics = false;
+	const char* instructionSet = NULL;
+	const char* scene = "default";
+	const char* textureFileName = NULL;
+	u64 textureCacheSize = DEFAULT_TEXTURE_CACHE_SIZE;
+} renderSettings;
+
+// -----------------------------------------------
+// @denpa: The output of a frame.
+// Alongside the colours, the first hit normal and depth of every pixel are kept to guide the denoiser.
+// Pixels that don't hit anything have a depth of 0 and a zero normal.
+// -----------------------------------------------
+typedef struct frameBuffer {
+	colour* pixels = NULL;
+	vector* normals = NULL;
+	f32* depths = NULL;
+	u32 width = 0;
+	u32 height = 0;
+} frameBuffer;
+
+// -----------------------------------------------
+// @denpa: Counts the work done while rendering. Every hit casts one shadow ray per light.
+// -----------------------------------------------
+typedef struct renderStatistics {
+	u64 cameraRays = 0;
+	u64 shadowRays = 0;
+} renderStatistics;
+
+// -----------------------------------------------
+// @denpa: The number of bytes a frame buffer of the given size takes up, padding for alignment included.
+// -----------------------------------------------
+INTERNAL DINLINE u64 frameBufferMemorySize(u32 width, u32 height) {
+	u64 pixelCount = (u64)width * height;
+	return ((sizeof(colour) + sizeof(vector) + sizeof(f32)) * pixelCount) + (3 * ARENA_DEFAULT_ALIGNMENT);
+}
+
+// -----------------------------------------------
+// @denpa: Allocates a frame buffer of the given size from the arena.
+// -----------------------------------------------
+INTERNAL DNOINLINE frameBuffer createFrameBuffer(memoryArena* arena, u32 width, u32 height) {
+	u64 pixelCount = (u64)width * height;
+	return (frameBuffer) {.pixels = PUSH_ARRAY(arena, colour, pixelCount),
+						.normals = PUSH_ARRAY(arena, vector, pixelCount),
+						.depths = PUSH_ARRAY(arena, f32, pixelCount),
+						.width = width,
+						.height = height};
+}
+
+// -----------------------------------------------
+// @denpa: Parses the command line arguments into the render settings.
+// Unknown arguments are reported and ignored, and so is --progressive when --deadline is given as well.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderSettings parseRenderSettings(int argc, const char** argv) {
+	renderSettings settings = {};
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = (i + 1) < argc;
+		if (hasValue && strcmp(argv[i], "--samples") == 0) {
+			u32 samplesPerPixel = (u32)atoi(argv[++i]);
+			settings.samplesPerPixel = DENPA_MAX(samplesPerPixel, 1u);
+		} else if (hasValue && strcmp(argv[i], "--threads") == 0) {
+			settings.threadCount = (u32)atoi(argv[++i]);
+		} else if (hasValue && strcmp(argv[i], "--seed") == 0) {
+			settings.seed = (u32)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--progressive") == 0) {
+			settings.progressive = true;
+		} else if (hasValue && strcmp(argv[i], "--time-budget") == 0) {
+			settings.timeBudget = (u32)atoi(argv[++i]);
+		} else if (hasValue && strcmp(argv[i], "--deadline") == 0) {
+			settings.deadline = (u32)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--denoise") == 0) {
+			settings.denoise = true;
+		} else if (strcmp(argv[i], "--no-culling") == 0) {
+			settings.cull = false;
+		} else if (hasValue && strcmp(argv[i], "--isa") == 0) {
+			settings.instructionSet = argv[++i];
+		} else if (hasValue && strcmp(argv[i], "--scene") == 0) {
+			settings.scene = argv[++i];
+		} else if (hasValue && strcmp(argv[i], "--texture") == 0) {
+			settings.textureFileName = argv[++i];
+		} else if (hasValue && strcmp(argv[i], "--texture-cache") == 0) {
+			settings.textureCacheSize = DENPA_MEGABYTES(strtoull(argv[++i], NULL, 10));
+		} else if (strcmp(argv[i], "--memory-stats") == 0) {
+			settings.printMemoryStatistics = true;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+		}
+	}
+	if (settings.deadline && settings.progressive) {
+		printf("--deadline overrides --progressive, the frame is rendered once within %u ms\n", settings.deadline);
+		settings.progressive = false;
+	}
+	return settings;
+}
+
+// -----------------------------------------------
+// @denpa: Traces a single camera ray and returns the colour it sees.
+// The normal and the distance to the hit are also written out for the frame buffer, both are left at 0 on a miss.
+// The ray widens by pixelSpread per unit of distance, which sets how much the textures get filtered.
+// When candidates is not NULL, the ray is only tested against those shapes. Shadow rays always go through the whole world.
+// -----------------------------------------------
+INTERNAL DINLINE colour traceSample(world* world, tileCandidates* candidates, ray ray, f32 pixelSpread, u32 pixelIndex, u32 sampleIndex, u32 seed,
+									shadingQuality shading, vector* normalOut, f32* depthOut) {
+	worldHit result = candidates ? findCandidateHit(candidates, ray) : findWorldHit(world, ray);
+	if (result.index == SHAPE_SET_MISS) {return createColour(0.f, 0.f, 0.f, 0.f);}
+
+	point intersectionPoint = findRayPosition(ray.rayOrigin, ray.rayDirection, result.t);
+	vector normal = findShapeNormalAt(world, result, intersectionPoint);
+	vector eye = negateTuple(ray.rayDirection);
+	*normalOut = normal;
+	*depthOut = result.t;
+	material material = *getShapeMaterial(world, result);
+	if (material.texture != NO_TEXTURE) {
+		colour textureColour = findTextureColour(world, &material, result, intersectionPoint, normal, ray.rayDirection, pixelSpread);
+		material.surfaceColour = multiplyTuples(material.surfaceColour, textureColour);
+	}
+	return shadeAreaLights(world, material, intersectionPoint, eye, normal, pixelIndex, sampleIndex, seed, shading);
+}
+
+// -----------------------------------------------
+// @denpa: Traces the given sample of the block of blockWidth by blockHeight pixels whose top left pixel is (x, y).
+// The sample is a pixel wide, jittered by the low discrepancy sequence around the centre of the block, and keyed on the top left pixel.
+// -----------------------------------------------
+INTERNAL DINLINE colour traceBlockSample(world* world, tileCandidates* candidates, camera* camera, renderSettings* settings, u32 x, u32 y,
+										 u32 blockWidth, u32 blockHeight, u32 sampleIndex, vector* normalOut, f32* depthOut) {
+	f32 half = camera->wallSize / 2.f;
+	f32 pixelSize = camera->wallSize / (f32)settings->canvasX;
+	u32 pixelIndex = (y * settings->canvasX) + x;
+	sample2D jitter = lowDiscrepancySample2D(pixelIndex, sampleIndex, SAMPLE_DIMENSION_PIXEL, settings->seed);
+	f32 worldX = -half + (pixelSize * ((f32)x + ((f32)(blockWidth - 1) / 2.f) + jitter.u));
+	f32 worldY = half - (pixelSize * ((f32)y + ((f32)(blockHeight - 1) / 2.f) + jitter.v));
+	point position = createPoint(worldX, worldY, camera->wallZ);
+	vector direction = subtractTuples(position, camera->origin);
+	ray ray = {camera->origin, normalizeTuple(direction)};
+	return traceSample(world, candidates, ray, pixelSize / magnitudeOfTuple(direction), pixelIndex, sampleIndex, settings->seed, settings->shading,
+					   normalOut, depthOut);
+}
+
+// -----------------------------------------------
+// @denpa: Traces the given sample of the pixel at (x, y), jittered inside the pixel by the low discrepancy sequence.
+// -----------------------------------------------
+INTERNAL DINLINE colour tracePixelSample(world* world, tileCandidates* candidates, camera* camera, renderSettings* settings, u32 x, u32 y, u32 sampleIndex,
+										 vector* normalOut, f32* depthOut) {
+	return traceBlockSample(world, candidates, camera, settings, x, y, 1, 1, sampleIndex, normalOut, depthOut);
+}
+
+// -----------------------------------------------
+// @denpa: Renders every pixel inside the given rectangle of the canvas.
+// Each pixel takes samplesPerPixel jittered samples, all of them keyed on the pixel index and sample index only.
+// The tile is rendered one sample at a time into accumulation buffers in the scratch arena, so every pixel
+// of the tile has the same number of samples at the end of each pass.
+// The normals and depths stored are the averages over the samples of the pixel that hit something, the normals are renormalized,
+// so a pixel on a silhouette keeps the depth of the surface instead of a blend with the background.
+// With screen space bins, a tile that no shape overlaps is cleared without tracing anything,
+// and the other tiles only test their own shapes, which are copied into the scratch arena.
+// With a resolutionScale above 1 every block is traced once at its centre, and all of its pixels copy the result.
+// The blocks on the right and bottom edges of the tile are cut short by the tile, and are traced at the centre of what is left.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics renderTile(world* world, camera* camera, renderSettings* settings, frameBuffer* buffer, memoryArena* scratch,
+											   screenBins* bins, u32 startX, u32 startY, u32 endX, u32 endY) {
+	f32 inverseSampleCount = 1.f / (f32)settings->samplesPerPixel;
+	u32 tileWidth = endX - startX;
+	u32 tilePixelCount = tileWidth * (endY - startY);
+	u32 scale = settings->resolutionScale;
+	u64 tracedPixelCount = (u64)((tileWidth + scale - 1) / scale) * ((endY - startY + scale - 1) / scale);
+	u64 hitCount = 0;
+
+	if (bins && isTileEmpty(bins, getPixelTile(bins, startX, startY))) {
+		for (u32 y = startY; y < endY; y++) {
+			for (u32 x = startX; x < endX; x++) {
+				u32 pixelIndex = (y * settings->canvasX) + x;
+				buffer->pixels[pixelIndex] = createColour(0.f, 0.f, 0.f, 0.f);
+				buffer->normals[pixelIndex] = createVector(0.f, 0.f, 0.f);
+				buffer->depths[pixelIndex] = 0.f;
+			}
+		}
+		return renderStatistics {};
+	}
+
+	temporaryMemory temporary = beginTemporaryMemory(scratch);
+	tileCandidates candidates = {};
+	tileCandidates* tileShapes = NULL;
+	if (bins && gatherTileCandidates(bins, world, getPixelTile(bins, startX, startY), scratch, &candidates)) {tileShapes = &candidates;}
+	colour* accumulatedColours = PUSH_ARRAY(scratch, colour, tilePixelCount);
+	vector* accumulatedNormals = PUSH_ARRAY(scratch, vector, tilePixelCount);
+	f32* accumulatedDepths = PUSH_ARRAY(scratch, f32, tilePixelCount);
+	u32* accumulatedHits = PUSH_ARRAY(scratch, u32, tilePixelCount);
+	for (u32 i = 0; i < tilePixelCount; i++) {
+		accumulatedColours[i] = createColour(0.f, 0.f, 0.f, 0.f);
+		accumulatedNormals[i] = createVector(0.f, 0.f, 0.f);
+		accumulatedDepths[i] = 0.f;
+		accumulatedHits[i] = 0;
+	}
+
+	for (u32 s = 0; s < settings->samplesPerPixel; s++) {
+		for (u32 y = startY; y < endY; y += scale) {
+			for (u32 x = startX; x < endX; x += scale) {
+				u32 tileIndex = ((y - startY) * tileWidth) + (x - startX);
+				vector normal = createVector(0.f, 0.f, 0.f);
+				f32 depth = 0.f;
+				u32 blockWidth = DENPA_MIN(scale, endX - x);
+				u32 blockHeight = DENPA_MIN(scale, endY - y);
+				colour sampleColour = traceBlockSample(world, tileShapes, camera, settings, x, y, blockWidth, blockHeight, s, &normal, &depth);
+				accumulatedColours[tileIndex] = addTuples(accumulatedColours[tileIndex], sampleColour);
+				accumulatedNormals[tileIndex] = addTuples(accumulatedNormals[tileIndex], normal);
+				accumulatedDepths[tileIndex] += depth;
+				accumulatedHits[tileIndex] += (depth > 0.f);
+				hitCount += (depth > 0.f);
+			}
+		}
+	}
+
+	for (u32 y = startY; y < endY; y++) {
+		for (u32 x = startX; x < endX; x++) {
+			u32 pixelIndex = (y * settings->canvasX) + x;
+			u32 tileIndex = ((y - startY) / scale * scale * tileWidth) + ((x - startX) / scale * scale);
+			u32 hits = accumulatedHits[tileIndex];
+			buffer->pixels[pixelIndex] = scaleTuple(accumulatedColours[tileIndex], inverseSampleCount);
+			buffer->normals[pixelIndex] = hits ? normalizeTuple(accumulatedNormals[tileIndex]) : accumulatedNormals[tileIndex];
+			buffer->depths[pixelIndex] = hits ? accumulatedDepths[tileIndex] / (f32)hits : 0.f;
+		}
+	}
+	endTemporaryMemory(temporary);
+	u64 shadowRayCount = (settings->shading == SHADING_FULL) ? hitCount * world->lightCount : 0;
+	return renderStatistics {.cameraRays = tracedPixelCount * settings->samplesPerPixel, .shadowRays = shadowRayCount};
+}
+
+// -----------------------------------------------
+// @denpa: Sorts the shapes into the tiles of the frame when culling is on.
+// Returns the bins, or NULL if the camera rays have to go through the whole world.
+// -----------------------------------------------
+INTERNAL DNOINLINE screenBins* prepareScreenBins(world* world, camera* camera, renderSettings* settings, screenBins* bins) {
+	if (!settings->cull) {return NULL;}
+	*bins = {.eye = camera->origin, .wallZ = camera->wallZ, .wallSize = camera->wallSize,
+			 .canvasX = settings->canvasX, .canvasY = settings->canvasY, .tileSize = settings->tileSize,
+			 .tilesX = (settings->canvasX + settings->tileSize - 1) / settings->tileSize,
+			 .tilesY = (settings->canvasY + settings->tileSize - 1) / settings->tileSize};
+	return binShapesOnScreen(bins, world) ? bins : NULL;
+}
+
+// -----------------------------------------------
+// @denpa: Splits the canvas into tiles and renders them on all the worker threads.
+// The tile schedule changes from run to run but the image does not.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics renderFrame(world* world, camera* camera, renderSettings* settings, frameBuffer* buffer) {
+	u32 tilesX = (settings->canvasX + settings->tileSize - 1) / settings->tileSize;
+	u32 tilesY = (settings->canvasY + settings->tileSize - 1) / settings->tileSize;
+	renderStatistics threadStatistics[MAX_THREAD_COUNT] = {};
+	screenBins binStorage = {};
+	screenBins* bins = prepareScreenBins(world, camera, settings, &binStorage);
+
+	parallelFor(tilesX * tilesY, settings->threadCount, [&](u32 tile, u32 threadIndex) {
+		memoryArena* scratch = getScratchArena(threadIndex);
+		resetArena(scratch);
+		u32 startX = (tile % tilesX) * settings->tileSize;
+		u32 startY = (tile / tilesX) * settings->tileSize;
+		u32 endX = DENPA_MIN(startX + settings->tileSize, settings->canvasX);
+		u32 endY = DENPA_MIN(startY + settings->tileSize, settings->canvasY);
+		renderStatistics tileStatistics = renderTile(world, camera, settings, buffer, scratch, bins, startX, startY, endX, endY);
+		threadStatistics[threadIndex].cameraRays += tileStatistics.cameraRays;
+		threadStatistics[threadIndex].shadowRays += tileStatistics.shadowRays;
+	});
+
+	renderStatistics statistics = {};
+	for (u32 i = 0; i < MAX_THREAD_COUNT; i++) {
+		statistics.cameraRays += threadStatistics[i].cameraRays;
+		statistics.shadowRays += threadStatistics[i].shadowRays;
+	}
+	return statistics;
+}
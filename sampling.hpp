@@ -0,0 +1,125 @@
+//  sampling.hpp
+//  Contains the random number generation and sample sequences used for Monte Carlo integration
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: Every random number is derived from (pixel, sample, dimension, seed) alone, never from some running state.
+// This keeps the output bitwise identical no matter how many threads there are or the order in which tiles get rendered.
+// Dimensions 0 and 1 are used for the position inside the pixel, the rest are used for the light samples.
+// -----------------------------------------------
+#define SAMPLE_DIMENSION_PIXEL 0
+#define SAMPLE_DIMENSION_LIGHT 2
+
+// -----------------------------------------------
+// @denpa: The R2 sequence constants (1/g and 1/g^2 where g is the plastic number) as 0.32 fixed point.
+// Doing the additions in integers keeps the sequence exact even for very high sample counts.
+// -----------------------------------------------
+#define R2_ALPHA_X 0xC13FA9A9u
+#define R2_ALPHA_Y 0x91E10DA5u
+
+// -----------------------------------------------
+// @denpa: A two dimensional sample in the range [0, 1).
+// -----------------------------------------------
+typedef struct sample2D {
+	f32 u = 0.f;
+	f32 v = 0.f;
+} sample2D;
+
+// -----------------------------------------------
+// @denpa: A low bias 32-bit integer hash. (lowbias32 by Chris Wellons)
+// -----------------------------------------------
+INTERNAL DINLINE u32 hashU32(u32 x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// -----------------------------------------------
+// @denpa: Counter based random number generator, the same counter always returns the same number.
+// -----------------------------------------------
+INTERNAL DINLINE u32 randomU32(u32 pixelIndex, u32 sampleIndex, u32 dimension, u32 seed) {
+	return hashU32(hashU32(hashU32(pixelIndex ^ hashU32(seed)) + sampleIndex) + dimension);
+}
+
+// -----------------------------------------------
+// @denpa: Converts the upper 24 bits of an integer into a float in the range [0, 1).
+// -----------------------------------------------
+INTERNAL DINLINE f32 u32ToUnitF32(u32 x) {
+	return (f32)(x >> 8) * (1.f / 16777216.f);
+}
+
+// -----------------------------------------------
+// @denpa: Returns a random float in the range [0, 1).
+// -----------------------------------------------
+INTERNAL DINLINE f32 randomF32(u32 pixelIndex, u32 sampleIndex, u32 dimension, u32 seed) {
+	return u32ToUnitF32(randomU32(pixelIndex, sampleIndex, dimension, seed));
+}
+
+// -----------------------------------------------
+// @denpa: Reverses the order of the bits.
+// -----------------------------------------------
+INTERNAL DINLINE u32 reverseBitsU32(u32 x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// -----------------------------------------------
+// @denpa: A nested uniform scramble of the bits, Owen scrambling in base 2. (Burley, Practical Hash-based Owen Scrambling)
+// Every bit is flipped depending on the bits above it only, so every aligned run of a power of 2 values
+// is mapped onto another aligned run of as many values, in a shuffled order.
+// -----------------------------------------------
+INTERNAL DINLINE u32 scrambleBits(u32 x, u32 seed) {
+	x = reverseBitsU32(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBitsU32(x);
+}
+
+// -----------------------------------------------
+// @denpa: Returns a point of the R2 low-discrepancy sequence for the pixel.
+// Every pixel and dimension pair gets its own random offset (Cranley-Patterson rotation) so that
+// neighbouring pixels don't share the same pattern, which would show up as structured noise.
+// On its own the offset would make the dimensions of a pixel shifted copies of each other, so every pair also
+// shuffles the order of the points and Owen scrambles their coordinates. Both keep aligned runs together,
+// so the samples of a pixel stay as well spread as before.
+// -----------------------------------------------
+INTERNAL DINLINE sample2D lowDiscrepancySample2D(u32 pixelIndex, u32 sampleIndex, u32 dimension, u32 seed) {
+	u32 offsetX = randomU32(pixelIndex, 0xFFFFFFFFu, dimension, seed);
+	u32 offsetY = randomU32(pixelIndex, 0xFFFFFFFFu, dimension + 1, seed);
+	u32 index = scrambleBits(sampleIndex, randomU32(pixelIndex, 0xFFFFFFFEu, dimension, seed));
+	u32 x = scrambleBits(offsetX + (index * R2_ALPHA_X), randomU32(pixelIndex, 0xFFFFFFFDu, dimension, seed));
+	u32 y = scrambleBits(offsetY + (index * R2_ALPHA_Y), randomU32(pixelIndex, 0xFFFFFFFDu, dimension + 1, seed));
+	return sample2D {.u = u32ToUnitF32(x), .v = u32ToUnitF32(y)};
+}
+
+// -----------------------------------------------
+// @denpa: Maps a sample in the unit square onto the unit disk.
+// Uses the concentric mapping so that the stratification of the sample is preserved.
+// -----------------------------------------------
+INTERNAL DINLINE sample2D mapSampleToDisk(sample2D s) {
+	f32 x = (2.f * s.u) - 1.f;
+	f32 y = (2.f * s.v) - 1.f;
+	if (x == 0.f && y == 0.f) {return sample2D {.u = 0.f, .v = 0.f};}
+
+	f32 radius = 0.f;
+	f32 theta = 0.f;
+	if (fabsf(x) > fabsf(y)) {
+		radius = x;
+		theta = (f32)(PI32 / 4.0) * (y / x);
+	} else {
+		radius = y;
+		theta = (f32)(PI32 / 2.0) - ((f32)(PI32 / 4.0) * (x / y));
+	}
+	return sample2D {.u = radius * cosf(theta), .v = radius * sinf(theta)};
+}
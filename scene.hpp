@@ -0,0 +1,233 @@
+//  scene.hpp
+//  Contains the scenes that get rendered and the path that turns a scene into an image
+//  Created by 電波
+
+#pragma once
+
+// -----------------------------------------------
+// @denpa: The number of bytes the shape set of the given type takes up in the arena.
+// -----------------------------------------------
+INTERNAL DINLINE u64 shapeSetMemorySize(shapeType type, u64 count) {
+	return (sizeof(f32) * shapeSetArrayCounts[type] * (count + SHAPE_SET_PADDING)) + ARENA_DEFAULT_ALIGNMENT;
+}
+
+// -----------------------------------------------
+// @denpa: The number of bytes the scene arrays of a world take up in the arena, padding for alignment included.
+// -----------------------------------------------
+INTERNAL DINLINE u64 sceneMemorySize(u64 sphereCount, u64 planeCount, u64 boxCount, u64 cylinderCount, u64 coneCount, u64 lightCount) {
+	u64 shapeSize = (sizeof(sphere) * sphereCount) + (sizeof(plane) * planeCount) + (sizeof(box) * boxCount) +
+					(sizeof(cylinder) * cylinderCount) + (sizeof(cone) * coneCount);
+	u64 shapeSetSize = shapeSetMemorySize(SHAPE_SPHERE, sphereCount) + shapeSetMemorySize(SHAPE_PLANE, planeCount) + shapeSetMemorySize(SHAPE_BOX, boxCount) +
+					   shapeSetMemorySize(SHAPE_CYLINDER, cylinderCount) + shapeSetMemorySize(SHAPE_CONE, coneCount);
+	return shapeSize + (sizeof(areaLight) * lightCount) + shapeSetSize + (6 * ARENA_DEFAULT_ALIGNMENT);
+}
+
+// -----------------------------------------------
+// @denpa: Allocates an empty shape set of the given type and copies the inverse transformations into it.
+// -----------------------------------------------
+template <typename shape>
+INTERNAL DNOINLINE shapeSet createShapeSet(memoryArena* arena, shapeType type, shape* shapes, u64 count) {
+	shapeSet set = {.count = count, .paddedCount = ((count + SHAPE_SET_PADDING - 1) / SHAPE_SET_PADDING) * SHAPE_SET_PADDING};
+	set.data = PUSH_ARRAY(arena, f32, shapeSetArrayCounts[type] * set.paddedCount);
+	memset(set.data, 0, sizeof(f32) * shapeSetArrayCounts[type] * set.paddedCount);
+	for (u64 i = 0; i < count; i++) {
+		for (u64 j = 0; j < 12; j++) {set.data[(j * set.paddedCount) + i] = shapes[i].inverseTransformation.v[j];}
+	}
+	return set;
+}
+
+// -----------------------------------------------
+// @denpa: Copies the shapes of the world into the layout used by the SIMD kernels, and marks the shape sets as up to date.
+// Has to be called again whenever a shape is added or its transformation changes, see markShapesChanged().
+// -----------------------------------------------
+INTERNAL DNOINLINE void createShapeSets(memoryArena* arena, world* world) {
+	shapeSet* sets = world->shapeSets;
+	sets[SHAPE_SPHERE] = createShapeSet(arena, SHAPE_SPHERE, world->spheres, world->sphereCount);
+	for (u64 i = 0; i < world->sphereCount; i++) {
+		for (u32 axis = 0; axis < 3; axis++) {
+			sets[SHAPE_SPHERE].data[((SHAPE_SET_ORIGIN_X + axis) * sets[SHAPE_SPHERE].paddedCount) + i] = world->spheres[i].origin.v[axis];
+		}
+	}
+
+	sets[SHAPE_PLANE] = createShapeSet(arena, SHAPE_PLANE, world->planes, world->planeCount);
+
+	sets[SHAPE_BOX] = createShapeSet(arena, SHAPE_BOX, world->boxes, world->boxCount);
+	for (u64 i = 0; i < world->boxCount; i++) {
+		for (u32 axis = 0; axis < 3; axis++) {
+			sets[SHAPE_BOX].data[((SHAPE_SET_MINIMUM_X + axis) * sets[SHAPE_BOX].paddedCount) + i] = world->boxes[i].minimum.v[axis];
+			sets[SHAPE_BOX].data[((SHAPE_SET_MAXIMUM_X + axis) * sets[SHAPE_BOX].paddedCount) + i] = world->boxes[i].maximum.v[axis];
+		}
+	}
+
+	sets[SHAPE_CYLINDER] = createShapeSet(arena, SHAPE_CYLINDER, world->cylinders, world->cylinderCount);
+	for (u64 i = 0; i < world->cylinderCount; i++) {
+		sets[SHAPE_CYLINDER].data[(SHAPE_SET_MINIMUM * sets[SHAPE_CYLINDER].paddedCount) + i] = world->cylinders[i].minimum;
+		sets[SHAPE_CYLINDER].data[(SHAPE_SET_MAXIMUM * sets[SHAPE_CYLINDER].paddedCount) + i] = world->cylinders[i].maximum;
+		sets[SHAPE_CYLINDER].data[(SHAPE_SET_CLOSED * sets[SHAPE_CYLINDER].paddedCount) + i] = world->cylinders[i].closed ? 1.f : 0.f;
+	}
+
+	sets[SHAPE_CONE] = createShapeSet(arena, SHAPE_CONE, world->cones, world->coneCount);
+	for (u64 i = 0; i < world->coneCount; i++) {
+		sets[SHAPE_CONE].data[(SHAPE_SET_MINIMUM * sets[SHAPE_CONE].paddedCount) + i] = world->cones[i].minimum;
+		sets[SHAPE_CONE].data[(SHAPE_SET_MAXIMUM * sets[SHAPE_CONE].paddedCount) + i] = world->cones[i].maximum;
+		sets[SHAPE_CONE].data[(SHAPE_SET_CLOSED * sets[SHAPE_CONE].paddedCount) + i] = world->cones[i].closed ? 1.f : 0.f;
+	}
+	world->shapeSetsDirty = false;
+}
+
+// -----------------------------------------------
+// @denpa: The light shared by all the scenes.
+// -----------------------------------------------
+INTERNAL DINLINE areaLight createSceneLight(void) {
+	return createSphereLight(createColour(1.f, 1.f, 1.f, 1.f), createPoint(-10.f, 10.f, -10.f), 2.f);
+}
+
+// -----------------------------------------------
+// @denpa: A pink sphere sitting on a floor, lit by a single sphere light.
+// -----------------------------------------------
+INTERNAL DNOINLINE world createDefaultScene(memoryArena* arena) {
+	world world = {.sphereCount = 1, .planeCount = 1, .lightCount = 1};
+	world.lights = PUSH_ARRAY(arena, areaLight, 1);
+	world.lights[0] = createSceneLight();
+
+	world.spheres = PUSH_ARRAY(arena, sphere, 1);
+	world.spheres[0] = createSphere();
+	world.spheres[0].material.surfaceColour = createColour(1.f, .2f, 1.f, 1.f);
+
+	world.planes = PUSH_ARRAY(arena, plane, 1);
+	world.planes[0] = {};
+	setShapeTransformation(&world, &world.planes[0], createTranslationMatrix(0.f, -1.f, 0.f));
+	world.planes[0].material.surfaceColour = createColour(.8f, .8f, .8f, 1.f);
+	world.planes[0].material.specular = 0.f;
+
+	createShapeSets(arena, &world);
+	return world;
+}
+
+// -----------------------------------------------
+// @denpa: One of every primitive standing on a floor: a sphere in the middle, a box on the left,
+// a closed cylinder on the right and a cone at the back.
+// The light is a square panel where the sphere light of the other scenes would be, so both kinds of area light get used.
+// -----------------------------------------------
+INTERNAL DNOINLINE world createPrimitiveScene(memoryArena* arena) {
+	world world = {.sphereCount = 1, .planeCount = 1, .boxCount = 1, .cylinderCount = 1, .coneCount = 1, .lightCount = 1};
+	world.lights = PUSH_ARRAY(arena, areaLight, 1);
+	world.lights[0] = createRectangleLight(createColour(1.f, 1.f, 1.f, 1.f), createPoint(-12.f, 10.f, -12.f), createVector(4.f, 0.f, 0.f), createVector(0.f, 0.f, 4.f));
+
+	world.spheres = PUSH_ARRAY(arena, sphere, 1);
+	world.spheres[0] = createSphere();
+	setSphereTransformation(&world, &world.spheres[0], multiplyMatrices4x4(createTranslationMatrix(0.f, -.6f, .5f), createScaleMatrix(.4f, .4f, .4f)));
+	world.spheres[0].material.surfaceColour = createColour(1.f, .2f, 1.f, 1.f);
+
+	world.planes = PUSH_ARRAY(arena, plane, 1);
+	world.planes[0] = {};
+	setShapeTransformation(&world, &world.planes[0], createTranslationMatrix(0.f, -1.f, 0.f));
+	world.planes[0].material.surfaceColour = createColour(.8f, .8f, .8f, 1.f);
+	world.planes[0].material.specular = 0.f;
+
+	world.boxes = PUSH_ARRAY(arena, box, 1);
+	world.boxes[0] = {.minimum = createPoint(-.3f, 0.f, -.3f), .maximum = createPoint(.3f, .6f, .3f)};
+	setShapeTransformation(&world, &world.boxes[0], multiplyMatrices4x4(createTranslationMatrix(-1.1f, -1.f, 1.f), createRotationMatrixYAxis(-(f32)PI32 / 6.f)));
+	world.boxes[0].material.surfaceColour = createColour(.2f, .6f, 1.f, 1.f);
+
+	world.cylinders = PUSH_ARRAY(arena, cylinder, 1);
+	world.cylinders[0] = {.minimum = 0.f, .maximum = 1.f, .closed = true};
+	setShapeTransformation(&world, &world.cylinders[0], multiplyMatrices4x4(createTranslationMatrix(1.1f, -1.f, 1.f), createScaleMatrix(.3f, .9f, .3f)));
+	world.cylinders[0].material.surfaceColour = createColour(1.f, .8f, .2f, 1.f);
+
+	world.cones = PUSH_ARRAY(arena, cone, 1);
+	world.cones[0] = {.minimum = -1.5f, .maximum = 0.f, .closed = true};
+	setShapeTransformation(&world, &world.cones[0], createTranslationMatrix(0.f, .5f, 3.f));
+	world.cones[0].material.surfaceColour = createColour(.3f, 1.f, .4f, 1.f);
+
+	createShapeSets(arena, &world);
+	return world;
+}
+
+// -----------------------------------------------
+// @denpa: The primitive scene with a texture on every surface. The sphere shows the image in textureFileName,
+// or stripes when there is no image. Textured surfaces are white, so that the texture shows its own colours.
+// -----------------------------------------------
+INTERNAL DNOINLINE world createTextureScene(memoryArena* arena, const char* textureFileName) {
+	world world = createPrimitiveScene(arena);
+	colour white = createColour(1.f, 1.f, 1.f, 1.f);
+	u32 sphereTexture = textureFileName ? addImageTexture(textureFileName, 1.f) : NO_TEXTURE;
+	if (sphereTexture == NO_TEXTURE) {sphereTexture = addProceduralTexture(TEXTURE_STRIPES, createColour(1.f, .2f, 1.f, 1.f), white, 8.f);}
+
+	world.spheres[0].material.texture = sphereTexture;
+	world.planes[0].material.texture = addProceduralTexture(TEXTURE_CHECKER, createColour(.9f, .9f, .9f, 1.f), createColour(.1f, .1f, .1f, 1.f), 1.f);
+	world.boxes[0].material.texture = addProceduralTexture(TEXTURE_GRADIENT, createColour(.2f, .6f, 1.f, 1.f), createColour(1.f, .3f, .2f, 1.f), 1.f);
+	world.cylinders[0].material.texture = addProceduralTexture(TEXTURE_STRIPES, createColour(1.f, .8f, .2f, 1.f), createColour(.6f, .3f, .1f, 1.f), 12.f);
+	world.cones[0].material.texture = addProceduralTexture(TEXTURE_CHECKER, createColour(.3f, 1.f, .4f, 1.f), createColour(.1f, .4f, .2f, 1.f), 6.f);
+	world.spheres[0].material.surfaceColour = white;
+	world.planes[0].material.surfaceColour = white;
+	world.boxes[0].material.surfaceColour = white;
+	world.cylinders[0].material.surfaceColour = white;
+	world.cones[0].material.surfaceColour = white;
+	return world;
+}
+
+// -----------------------------------------------
+// @denpa: Spheres laid out on a square grid facing the default camera, filling the same area as the unit sphere.
+// A single sphere is just the unit sphere. The colours change across the grid so that misplaced spheres show up.
+// -----------------------------------------------
+INTERNAL DNOINLINE world createSphereGridScene(memoryArena* arena, u64 sphereCount) {
+	areaLight* lights = PUSH_ARRAY(arena, areaLight, 1);
+	lights[0] = createSceneLight();
+
+	sphere* spheres = PUSH_ARRAY(arena, sphere, sphereCount);
+	world world = {.spheres = spheres, .sphereCount = sphereCount, .lights = lights, .lightCount = 1};
+	u64 gridSize = (u64)ceil(sqrt((f64)sphereCount));
+	f32 cellSize = 2.f / (f32)gridSize;
+	for (u64 i = 0; i < sphereCount; i++) {
+		f32 column = (f32)(i % gridSize);
+		f32 row = (f32)(i / gridSize);
+		spheres[i] = createSphere();
+		if (sphereCount > 1) {
+			f32 x = -1.f + (cellSize * (column + .5f));
+			f32 y = 1.f - (cellSize * (row + .5f));
+			f32 radius = cellSize * .4f;
+			setSphereTransformation(&world, &spheres[i], multiplyMatrices4x4(createTranslationMatrix(x, y, 0.f), createScaleMatrix(radius, radius, radius)));
+		}
+		spheres[i].material.surfaceColour = createColour(1.f - (column / (f32)gridSize), .2f + (.8f * row / (f32)gridSize), 1.f, 1.f);
+	}
+
+	createShapeSets(arena, &world);
+	return world;
+}
+
+// -----------------------------------------------
+// @denpa: The number of bytes createNamedScene() may need from the arena, which is enough for any of the named scenes.
+// -----------------------------------------------
+INTERNAL DINLINE u64 namedSceneMemorySize(void) {
+	return sceneMemorySize(1, 1, 1, 1, 1, 1);
+}
+
+// -----------------------------------------------
+// @denpa: Creates the scene named in the settings, falling back to the default scene for unknown names.
+// -----------------------------------------------
+INTERNAL DNOINLINE world createNamedScene(memoryArena* arena, renderSettings* settings) {
+	const char* name = settings->scene;
+	if (strcmp(name, "primitives") == 0) {return createPrimitiveScene(arena);}
+	if (strcmp(name, "textures") == 0) {return createTextureScene(arena, settings->textureFileName);}
+	if (strcmp(name, "default") != 0) {printf("Unknown scene: %s\n", name);}
+	return createDefaultScene(arena);
+}
+
+// -----------------------------------------------
+// @denpa: Does everything that has to happen to a rendered frame buffer before the image is written out.
+// The arena needs denoiseMemorySize() bytes to spare when denoising is enabled.
+// -----------------------------------------------
+INTERNAL DNOINLINE void finishImage(renderSettings* settings, frameBuffer* buffer, memoryArena* arena) {
+	if (settings->denoise) {denoiseFrameBuffer(buffer, arena, settings->threadCount);}
+	kernels.clampAndScaleColours(buffer->pixels, (u64)buffer->width * buffer->height);
+}
+
+// -----------------------------------------------
+// @denpa: Renders the world into the frame buffer, ready to be written out.
+// -----------------------------------------------
+INTERNAL DNOINLINE renderStatistics renderImage(world* world, camera* camera, renderSettings* settings, frameBuffer* buffer, memoryArena* arena) {
+	renderStatistics statistics = renderFrame(world, camera, settings, buffer);
+	finishImage(settings, buffer, arena);
+	return statistics;
+}
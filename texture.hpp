@@ -0,0 +1,651 @@
+//  texture.hpp
+//  Contains the image and procedural textures, the texture cache and the mapping of the shapes to texture coordinates
+//  Created by 電波
+
+#pragma once
+
+#if DENPA_PLATFORM_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------
+// @denpa: Image textures are split into square tiles, and the texels inside a tile are stored in Morton order,
+// so that the 2 by 2 texels of a bilinear lookup are almost always in the same cache line.
+// A tile of RGBA8 texels is 4 KB, the size of a page.
+// -----------------------------------------------
+#define TEXTURE_TILE_SIZE 32
+#define TEXTURE_TILE_TEXEL_COUNT (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE)
+#define TEXTURE_TILE_BYTES (TEXTURE_TILE_TEXEL_COUNT * sizeof(u32))
+#define MAX_TEXTURE_COUNT 256
+#define MAX_TEXTURE_LEVEL_COUNT 24
+
+// -----------------------------------------------
+// @denpa: The texture cache never holds more than its budget of tiles. A thread building a mip tile pins one tile per level
+// while the tiles of the level below are fetched, so a small budget is raised until every thread can pin a tile of every level
+// and one slot is still free. A new tile then always finds a slot in the cache.
+// -----------------------------------------------
+#define DEFAULT_TEXTURE_CACHE_SIZE DENPA_MEGABYTES(64)
+#define MINIMUM_TEXTURE_CACHE_TILE_COUNT 64
+#define NO_TEXTURE_SLOT 0xFFFFFFFFu
+#define NO_TEXTURE_KEY 0xFFFFFFFFFFFFFFFFull
+
+// -----------------------------------------------
+// @denpa: A lookup without the lock walks at most this many slots of a bucket before it takes the lock instead.
+// There are at least as many buckets as slots, so the chains are almost always shorter than this.
+// -----------------------------------------------
+#define TEXTURE_LOOKUP_STEP_LIMIT 8
+
+// -----------------------------------------------
+// @denpa: Controls the footprint of a ray on a surface. Grazing angles stretch the footprint, up to this limit.
+// The minimum filter width keeps the filtered procedural patterns from dividing by 0.
+// -----------------------------------------------
+#define TEXTURE_MINIMUM_COSINE 0.05f
+#define TEXTURE_MINIMUM_FILTER_WIDTH 0.0001f
+
+// -----------------------------------------------
+// @denpa: The kinds of texture a material can be bound to.
+// The procedural patterns alternate between two colours, and their scale is the number of cells per unit of texture coordinates.
+// -----------------------------------------------
+typedef enum textureType : u32 {
+	TEXTURE_IMAGE = 0,
+	TEXTURE_CHECKER = 1,
+	TEXTURE_STRIPES = 2,
+	TEXTURE_GRADIENT = 3,
+} textureType;
+
+// -----------------------------------------------
+// @denpa: Texture data. The texels of image textures stay in the file and are read one tile at a time by the cache.
+// -----------------------------------------------
+typedef struct texture {
+	colour colourA = createColour(1.f, 1.f, 1.f, 1.f);
+	colour colourB = createColour(0.f, 0.f, 0.f, 1.f);
+	f32 scale = 1.f;
+	textureType type = TEXTURE_CHECKER;
+	u32 width = 0;
+	u32 height = 0;
+	u32 levelCount = 0;
+	FILE* file = NULL;
+	u64 dataOffset = 0;
+} texture;
+
+// -----------------------------------------------
+// @denpa: A slot is claimed in the loading state and put in the hash table right away, so that other threads
+// wanting the same tile wait for it instead of loading it again.
+// -----------------------------------------------
+typedef enum textureSlotState : u32 {
+	TEXTURE_SLOT_LOADING = 0,
+	TEXTURE_SLOT_READY = 1,
+} textureSlotState;
+
+// -----------------------------------------------
+// @denpa: A tile in the cache. The slots that share a bucket of the hash table are linked through next.
+// A tile survives as many turns of the clock hand without being used as it has chances.
+// Pins counts the threads reading or filling the tile, which is never evicted while it has any.
+// Everything but used is read without the lock and so is used atomically. Only pins and chances change without the lock.
+// -----------------------------------------------
+typedef struct textureCacheSlot {
+	u64 key = NO_TEXTURE_KEY;
+	u32 next = NO_TEXTURE_SLOT;
+	u32 chances = 0;
+	u32 pins = 0;
+	u32 state = TEXTURE_SLOT_LOADING;
+	bool used = false;
+} textureCacheSlot;
+
+// -----------------------------------------------
+// @denpa: The tiles of every image texture share one cache, which evicts with the clock algorithm once it is full.
+// The cache is shared by all the worker threads. Tiles that are already in the cache are found and pinned without the lock,
+// which is only held to claim a slot for a new tile. The texels are read from the file and the mip tiles are built without it.
+// -----------------------------------------------
+typedef struct textureCache {
+	u32* texels = NULL;
+	textureCacheSlot* slots = NULL;
+	u32* buckets = NULL;
+	u32 slotCount = 0;
+	u32 bucketMask = 0;
+	u32 clockHand = 0;
+	u64 hits = 0;
+	u64 misses = 0;
+	u64 evictions = 0;
+	std::mutex lock;
+} textureCache;
+
+// -----------------------------------------------
+// @denpa: A tile a thread is reading from, which is pinned in the cache until it is released.
+// -----------------------------------------------
+typedef struct textureTileReference {
+	u32* texels = NULL;
+	u64 key = 0;
+	u32 slot = NO_TEXTURE_SLOT;
+} textureTileReference;
+
+// -----------------------------------------------
+// @denpa: Every texture in the program. Materials refer to them by index.
+// The thread count is the most threads that will ever sample the textures at once.
+// -----------------------------------------------
+typedef struct textureSystem {
+	texture textures[MAX_TEXTURE_COUNT] = {};
+	u32 textureCount = 0;
+	u32 threadCount = MAX_THREAD_COUNT;
+	u64 cacheSize = DEFAULT_TEXTURE_CACHE_SIZE;
+	textureCache cache = {};
+} textureSystem;
+
+GLOBAL_VARIABLE textureSystem textures;
+
+// -----------------------------------------------
+// @denpa: Creates the texture cache in its own arena, with as many tiles as fit in the budget.
+// -----------------------------------------------
+INTERNAL DNOINLINE void createTextureCache(u64 size) {
+	textureCache* cache = &textures.cache;
+	u64 slotSize = TEXTURE_TILE_BYTES + sizeof(textureCacheSlot) + (2 * sizeof(u32));
+	u64 pinnedTileCount = (u64)textures.threadCount * MAX_TEXTURE_LEVEL_COUNT;
+	cache->slotCount = (u32)DENPA_MAX(DENPA_MAX(size / slotSize, (u64)MINIMUM_TEXTURE_CACHE_TILE_COUNT), pinnedTileCount + 1);
+	u32 bucketCount = 1;
+	while (bucketCount < cache->slotCount) {bucketCount <<= 1;}
+	cache->bucketMask = bucketCount - 1;
+
+	u64 arenaSize = ((u64)cache->slotCount * (TEXTURE_TILE_BYTES + sizeof(textureCacheSlot))) + (sizeof(u32) * bucketCount) + (3 * ARENA_DEFAULT_ALIGNMENT);
+	memory.textures = createArena("textures", arenaSize, false);
+	cache->texels = PUSH_ARRAY(&memory.textures, u32, (u64)cache->slotCount * TEXTURE_TILE_TEXEL_COUNT);
+	cache->slots = PUSH_ARRAY(&memory.textures, textureCacheSlot, cache->slotCount);
+	cache->buckets = PUSH_ARRAY(&memory.textures, u32, bucketCount);
+	for (u32 i = 0; i < cache->slotCount; i++) {cache->slots[i] = {};}
+	for (u32 i = 0; i < bucketCount; i++) {cache->buckets[i] = NO_TEXTURE_SLOT;}
+}
+
+// -----------------------------------------------
+// @denpa: Reads size bytes at the given byte offset, which can be past 2 GB for large textures.
+// The read doesn't use or move the position of the file, so several threads can read the same file at once.
+// -----------------------------------------------
+INTERNAL DINLINE bool readFileAt(FILE* file, u64 offset, void* data, u32 size) {
+#if DENPA_PLATFORM_WINDOWS
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD readSize = 0;
+	return ReadFile((HANDLE)_get_osfhandle(_fileno(file)), data, size, &readSize, &overlapped) && readSize == size;
+#else
+	return pread(fileno(file), data, size, (off_t)offset) == (ssize_t)size;
+#endif
+}
+
+// -----------------------------------------------
+// @denpa: Reads the next number of a .ppm header, skipping whitespace and comments.
+// -----------------------------------------------
+INTERNAL DNOINLINE bool readPPMHeaderNumber(FILE* file, u32* number) {
+	int c = fgetc(file);
+	while (c == '#' || isspace(c)) {
+		if (c == '#') {while (c != '\n' && c != EOF) {c = fgetc(file);}}
+		c = fgetc(file);
+	}
+	if (!isdigit(c)) {return false;}
+	*number = 0;
+	while (isdigit(c)) {
+		*number = (*number * 10) + (u32)(c - '0');
+		c = fgetc(file);
+	}
+	// @denpa: A single whitespace character separates the header from the texels.
+	return isspace(c);
+}
+
+// -----------------------------------------------
+// @denpa: Adds a texture with two colours that repeats scale times per unit of texture coordinates.
+// Returns NO_TEXTURE when there is no room left.
+// -----------------------------------------------
+INTERNAL DNOINLINE u32 addProceduralTexture(textureType type, colour colourA, colour colourB, f32 scale) {
+	if (textures.textureCount >= MAX_TEXTURE_COUNT) {printf("addProceduralTexture() failed, there are too many textures.\n"); return NO_TEXTURE;}
+	textures.textures[textures.textureCount] = (texture) {.colourA = colourA, .colourB = colourB, .scale = scale, .type = type};
+	return textures.textureCount++;
+}
+
+// -----------------------------------------------
+// @denpa: Adds an image texture from a binary .ppm file, like the ones createBinaryPPMFile() writes.
+// Only the header is read here, the texels are read by the cache when they are first needed.
+// Returns NO_TEXTURE if the file can't be used.
+// -----------------------------------------------
+INTERNAL DNOINLINE u32 addImageTexture(const char* fileName, f32 scale) {
+	if (textures.textureCount >= MAX_TEXTURE_COUNT) {printf("addImageTexture() failed, there are too many textures.\n"); return NO_TEXTURE;}
+	FILE* file = fopen(fileName, "rb");
+	if (!file) {perror("fopen() in addImageTexture() failed."); return NO_TEXTURE;}
+
+	u32 width = 0;
+	u32 height = 0;
+	u32 maximum = 0;
+	bool valid = fgetc(file) == 'P' && fgetc(file) == '6' && readPPMHeaderNumber(file, &width) && readPPMHeaderNumber(file, &height) &&
+				 readPPMHeaderNumber(file, &maximum) && width > 0 && height > 0 && maximum == 255;
+	if (!valid) {
+		printf("addImageTexture() failed, %s is not a binary .ppm file with 8 bits per channel.\n", fileName);
+		fclose(file);
+		return NO_TEXTURE;
+	}
+
+	if (!textures.cache.texels) {createTextureCache(textures.cacheSize);}
+	u32 levelCount = 1;
+	while (levelCount < MAX_TEXTURE_LEVEL_COUNT && (DENPA_MAX(width, height) >> levelCount) > 0) {levelCount++;}
+	textures.textures[textures.textureCount] = (texture) {.scale = scale, .type = TEXTURE_IMAGE, .width = width, .height = height,
+														  .levelCount = levelCount, .file = file, .dataOffset = (u64)ftell(file)};
+	return textures.textureCount++;
+}
+
+// -----------------------------------------------
+// @denpa: Closes the files of the image textures and forgets every texture. The cache memory belongs to the memory system.
+// -----------------------------------------------
+INTERNAL DNOINLINE void destroyTextures(void) {
+	for (u32 i = 0; i < textures.textureCount; i++) {
+		if (textures.textures[i].file) {fclose(textures.textures[i].file);}
+	}
+	textures.textureCount = 0;
+}
+
+// -----------------------------------------------
+// @denpa: Prints how well the texture cache did.
+// -----------------------------------------------
+INTERNAL DNOINLINE void printTextureCacheStatistics(void) {
+	textureCache* cache = &textures.cache;
+	if (!cache->texels) {return;}
+	u64 lookups = cache->hits + cache->misses;
+	printf("texture cache: %u tiles, %llu lookups, %.2f%% hits, %llu misses, %llu evictions\n", cache->slotCount, (unsigned long long)lookups,
+		   lookups ? 100.0 * (f64)cache->hits / (f64)lookups : 0.0, (unsigned long long)cache->misses, (unsigned long long)cache->evictions);
+}
+
+// -----------------------------------------------
+// @denpa: The size of a mip level, which halves with every level and never goes below 1.
+// -----------------------------------------------
+INTERNAL DINLINE u32 getLevelSize(u32 size, u32 level) {
+	return DENPA_MAX(size >> level, 1u);
+}
+
+// -----------------------------------------------
+// @denpa: Interleaves the bits of the coordinates inside a tile, so that nearby texels are nearby in memory.
+// -----------------------------------------------
+INTERNAL DINLINE u32 mortonIndex(u32 x, u32 y) {
+	u32 index = 0;
+	for (u32 bit = 0; (1u << bit) < TEXTURE_TILE_SIZE; bit++) {
+		index |= ((x >> bit) & 1u) << (2 * bit);
+		index |= ((y >> bit) & 1u) << ((2 * bit) + 1);
+	}
+	return index;
+}
+
+INTERNAL DINLINE u32 packTexel(u32 r, u32 g, u32 b, u32 a) {
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+INTERNAL DINLINE colour unpackTexel(u32 texel) {
+	f32 scale = 1.f / 255.f;
+	return createColour((f32)(texel & 0xFF) * scale, (f32)((texel >> 8) & 0xFF) * scale, (f32)((texel >> 16) & 0xFF) * scale, (f32)(texel >> 24) * scale);
+}
+
+// -----------------------------------------------
+// @denpa: Identifies a tile of a texture in the cache.
+// -----------------------------------------------
+INTERNAL DINLINE u64 textureTileKey(u32 textureIndex, u32 level, u32 tileX, u32 tileY) {
+	return ((u64)textureIndex << 48) | ((u64)level << 40) | ((u64)tileY << 20) | (u64)tileX;
+}
+
+INTERNAL DINLINE u32* getSlotTexels(textureCache* cache, u32 slot) {
+	return &cache->texels[(u64)slot * TEXTURE_TILE_TEXEL_COUNT];
+}
+
+// -----------------------------------------------
+// @denpa: Finds a slot for a new tile, evicting the first unpinned tile that has no chances left. The lock has to be held.
+// Every used tile gets one chance per mip level above the full size image plus one, since a mip tile is built from 4 tiles of the level below
+// and evicting it costs much more than evicting a tile that is read straight from the file.
+// The cache has more slots than the threads can pin at once, so there is always an unpinned tile to evict.
+// findTextureTile() can pin a tile right after its pins were checked, so the key is cleared before the pins are checked again.
+// Either the lookup then sees the cleared key, or this sees its pin and leaves the tile alone.
+// -----------------------------------------------
+INTERNAL DNOINLINE u32 allocateTextureSlot(textureCache* cache) {
+	for (;;) {
+		u32 index = cache->clockHand;
+		cache->clockHand = (cache->clockHand + 1) % cache->slotCount;
+		textureCacheSlot* slot = &cache->slots[index];
+		std::atomic_ref<u32> pins(slot->pins);
+		if (pins.load(std::memory_order_seq_cst) > 0) {continue;}
+		std::atomic_ref<u32> chances(slot->chances);
+		u32 chancesLeft = chances.load(std::memory_order_relaxed);
+		if (slot->used && chancesLeft > 0) {chances.store(chancesLeft - 1, std::memory_order_relaxed); continue;}
+
+		if (slot->used) {
+			u64 key = slot->key;
+			std::atomic_ref<u64> slotKey(slot->key);
+			slotKey.store(NO_TEXTURE_KEY, std::memory_order_seq_cst);
+			if (pins.load(std::memory_order_seq_cst) > 0) {
+				slotKey.store(key, std::memory_order_release);
+				continue;
+			}
+			u32* link = &cache->buckets[hashU32((u32)key ^ (u32)(key >> 32)) & cache->bucketMask];
+			while (*link != index) {link = &cache->slots[*link].next;}
+			std::atomic_ref<u32>(*link).store(slot->next, std::memory_order_release);
+			cache->evictions++;
+		}
+		return index;
+	}
+}
+
+// -----------------------------------------------
+// @denpa: Reads a tile of the full size image from the file. Texels past the edge of the image repeat the edge.
+// The lock doesn't have to be held.
+// -----------------------------------------------
+INTERNAL DNOINLINE void loadTextureTile(texture* texture, u32 tileX, u32 tileY, u32* texels) {
+	u8 row[TEXTURE_TILE_SIZE * 3] = {};
+	u32 startX = tileX * TEXTURE_TILE_SIZE;
+	u32 startY = tileY * TEXTURE_TILE_SIZE;
+	u32 columnCount = DENPA_MIN(texture->width - startX, (u32)TEXTURE_TILE_SIZE);
+	u32 rowCount = DENPA_MIN(texture->height - startY, (u32)TEXTURE_TILE_SIZE);
+	for (u32 y = 0; y < TEXTURE_TILE_SIZE; y++) {
+		if (y < rowCount) {
+			u64 offset = texture->dataOffset + ((((u64)(startY + y) * texture->width) + startX) * 3);
+			if (!readFileAt(texture->file, offset, row, columnCount * 3)) {memset(row, 0, sizeof(row));}
+		}
+		for (u32 x = 0; x < TEXTURE_TILE_SIZE; x++) {
+			u32 column = DENPA_MIN(x, columnCount - 1) * 3;
+			texels[mortonIndex(x, y)] = packTexel(row[column], row[column + 1], row[column + 2], 255);
+		}
+	}
+}
+
+INTERNAL u32* acquireTextureTile(textureTileReference* reference, u32 textureIndex, u32 level, u32 tileX, u32 tileY);
+
+// -----------------------------------------------
+// @denpa: Lets go of the tile, which can be evicted again once no other thread holds it.
+// -----------------------------------------------
+INTERNAL DINLINE void releaseTextureTile(textureTileReference* reference) {
+	if (reference->slot != NO_TEXTURE_SLOT) {
+		std::atomic_ref<u32>(textures.cache.slots[reference->slot].pins).fetch_sub(1, std::memory_order_release);
+	}
+	*reference = {};
+}
+
+// -----------------------------------------------
+// @denpa: Reads a texel of a mip level through the cache. The tile stays held by the reference for the next texel.
+// -----------------------------------------------
+INTERNAL DINLINE u32 readTexel(textureTileReference* reference, u32 textureIndex, u32 level, u32 x, u32 y) {
+	u32* tile = acquireTextureTile(reference, textureIndex, level, x / TEXTURE_TILE_SIZE, y / TEXTURE_TILE_SIZE);
+	return tile[mortonIndex(x % TEXTURE_TILE_SIZE, y % TEXTURE_TILE_SIZE)];
+}
+
+// -----------------------------------------------
+// @denpa: Builds a tile of a mip level by averaging 2 by 2 texels of the level below, which is fetched through the cache as well.
+// A tile covers 2 by 2 tiles of the level below, and the texels are visited one quarter at a time,
+// so that every tile below is fetched once even when the cache is too small to hold them all.
+// -----------------------------------------------
+INTERNAL DNOINLINE void buildMipTile(u32 textureIndex, u32 level, u32 tileX, u32 tileY, u32* texels) {
+	texture* texture = &textures.textures[textureIndex];
+	u32 width = getLevelSize(texture->width, level);
+	u32 height = getLevelSize(texture->height, level);
+	u32 childWidth = getLevelSize(texture->width, level - 1);
+	u32 childHeight = getLevelSize(texture->height, level - 1);
+	u32 half = TEXTURE_TILE_SIZE / 2;
+	textureTileReference child = {};
+	for (u32 quarter = 0; quarter < 4; quarter++) {
+		for (u32 y = (quarter >> 1) * half; y < ((quarter >> 1) + 1) * half; y++) {
+			for (u32 x = (quarter & 1) * half; x < ((quarter & 1) + 1) * half; x++) {
+				u32 levelX = DENPA_MIN((tileX * TEXTURE_TILE_SIZE) + x, width - 1);
+				u32 levelY = DENPA_MIN((tileY * TEXTURE_TILE_SIZE) + y, height - 1);
+				u32 sum[4] = {};
+				for (u32 i = 0; i < 4; i++) {
+					u32 childX = DENPA_MIN((levelX * 2) + (i & 1), childWidth - 1);
+					u32 childY = DENPA_MIN((levelY * 2) + (i >> 1), childHeight - 1);
+					u32 texel = readTexel(&child, textureIndex, level - 1, childX, childY);
+					for (u32 channel = 0; channel < 4; channel++) {sum[channel] += (texel >> (channel * 8)) & 0xFF;}
+				}
+				texels[mortonIndex(x, y)] = packTexel((sum[0] + 2) / 4, (sum[1] + 2) / 4, (sum[2] + 2) / 4, (sum[3] + 2) / 4);
+			}
+		}
+	}
+	releaseTextureTile(&child);
+}
+
+// -----------------------------------------------
+// @denpa: Loads or builds the texels of a tile. The lock doesn't have to be held.
+// -----------------------------------------------
+INTERNAL DINLINE void fillTextureTile(u32 textureIndex, u32 level, u32 tileX, u32 tileY, u32* texels) {
+	if (level == 0) {
+		loadTextureTile(&textures.textures[textureIndex], tileX, tileY, texels);
+	} else {
+		buildMipTile(textureIndex, level, tileX, tileY, texels);
+	}
+}
+
+// -----------------------------------------------
+// @denpa: Looks for the tile in its bucket without the lock and pins it. Returns NO_TEXTURE_SLOT if it isn't found.
+// The bucket can change during the walk, so the walk gives up after a few slots, and a slot with the right key
+// is only kept if it still has that key once it is pinned. allocateTextureSlot() does the other half of this.
+// -----------------------------------------------
+INTERNAL DINLINE u32 findTextureTile(textureCache* cache, u32* bucket, u64 key, u32 level) {
+	u32 index = std::atomic_ref<u32>(*bucket).load(std::memory_order_acquire);
+	for (u32 step = 0; step < TEXTURE_LOOKUP_STEP_LIMIT && index != NO_TEXTURE_SLOT; step++) {
+		textureCacheSlot* slot = &cache->slots[index];
+		std::atomic_ref<u64> slotKey(slot->key);
+		if (slotKey.load(std::memory_order_acquire) == key) {
+			std::atomic_ref<u32> pins(slot->pins);
+			pins.fetch_add(1, std::memory_order_seq_cst);
+			if (slotKey.load(std::memory_order_seq_cst) != key) {
+				pins.fetch_sub(1, std::memory_order_release);
+				return NO_TEXTURE_SLOT;
+			}
+			std::atomic_ref<u32>(slot->chances).store(level + 1, std::memory_order_relaxed);
+			std::atomic_ref<u64>(cache->hits).fetch_add(1, std::memory_order_relaxed);
+			return index;
+		}
+		index = std::atomic_ref<u32>(slot->next).load(std::memory_order_acquire);
+	}
+	return NO_TEXTURE_SLOT;
+}
+
+// -----------------------------------------------
+// @denpa: Makes the reference hold the tile and returns its texels, which stay valid until the reference is released
+// or moved to another tile. Nothing happens when the reference already holds the tile.
+// A tile in the cache is found and pinned without the lock, and a tile that another thread is still filling is waited for.
+// On a miss the lock is taken to claim a slot, and the tile is filled after the lock is given back,
+// so that only the threads wanting that tile wait for it.
+// -----------------------------------------------
+INTERNAL DNOINLINE u32* acquireTextureTile(textureTileReference* reference, u32 textureIndex, u32 level, u32 tileX, u32 tileY) {
+	u64 key = textureTileKey(textureIndex, level, tileX, tileY);
+	if (reference->texels && reference->key == key) {return reference->texels;}
+	releaseTextureTile(reference);
+
+	textureCache* cache = &textures.cache;
+	u32* bucket = &cache->buckets[hashU32((u32)key ^ (u32)(key >> 32)) & cache->bucketMask];
+	u32 index = findTextureTile(cache, bucket, key, level);
+	if (index == NO_TEXTURE_SLOT) {
+		// @denpa: Another thread may have just added the tile, or the walk gave up, so the bucket is searched again with the lock held.
+		cache->lock.lock();
+		index = findTextureTile(cache, bucket, key, level);
+		if (index == NO_TEXTURE_SLOT) {
+			cache->misses++;
+			index = allocateTextureSlot(cache);
+			textureCacheSlot* slot = &cache->slots[index];
+			std::atomic_ref<u32>(slot->next).store(*bucket, std::memory_order_relaxed);
+			std::atomic_ref<u32>(slot->chances).store(level + 1, std::memory_order_relaxed);
+			std::atomic_ref<u32>(slot->pins).store(1, std::memory_order_relaxed);
+			std::atomic_ref<u32>(slot->state).store(TEXTURE_SLOT_LOADING, std::memory_order_relaxed);
+			slot->used = true;
+			std::atomic_ref<u64>(slot->key).store(key, std::memory_order_release);
+			std::atomic_ref<u32>(*bucket).store(index, std::memory_order_release);
+			cache->lock.unlock();
+
+			*reference = {.texels = getSlotTexels(cache, index), .key = key, .slot = index};
+			fillTextureTile(textureIndex, level, tileX, tileY, reference->texels);
+			std::atomic_ref<u32> state(slot->state);
+			state.store(TEXTURE_SLOT_READY, std::memory_order_release);
+			state.notify_all();
+			return reference->texels;
+		}
+		cache->lock.unlock();
+	}
+
+	std::atomic_ref<u32> state(cache->slots[index].state);
+	while (state.load(std::memory_order_acquire) == TEXTURE_SLOT_LOADING) {state.wait(TEXTURE_SLOT_LOADING, std::memory_order_acquire);}
+	*reference = {.texels = getSlotTexels(cache, index), .key = key, .slot = index};
+	return reference->texels;
+}
+
+// -----------------------------------------------
+// @denpa: Bilinearly filters one mip level at the texture coordinates, which have to be in [0, 1]. The texture repeats.
+// The 4 texels are usually in the same tile, which is then only fetched once.
+// -----------------------------------------------
+INTERNAL DNOINLINE colour sampleTextureLevel(u32 textureIndex, u32 level, f32 u, f32 v) {
+	texture* texture = &textures.textures[textureIndex];
+	u32 width = getLevelSize(texture->width, level);
+	u32 height = getLevelSize(texture->height, level);
+	f32 x = (u * (f32)width) - .5f;
+	f32 y = (v * (f32)height) - .5f;
+	f32 floorX = floorf(x);
+	f32 floorY = floorf(y);
+	f32 fractionX = x - floorX;
+	f32 fractionY = y - floorY;
+	u32 x0 = (u32)(((i64)floorX % (i64)width + width) % width);
+	u32 y0 = (u32)(((i64)floorY % (i64)height + height) % height);
+	u32 x1 = (x0 + 1) % width;
+	u32 y1 = (y0 + 1) % height;
+
+	textureTileReference reference = {};
+	colour top = addTuples(scaleTuple(unpackTexel(readTexel(&reference, textureIndex, level, x0, y0)), 1.f - fractionX),
+						   scaleTuple(unpackTexel(readTexel(&reference, textureIndex, level, x1, y0)), fractionX));
+	colour bottom = addTuples(scaleTuple(unpackTexel(readTexel(&reference, textureIndex, level, x0, y1)), 1.f - fractionX),
+							  scaleTuple(unpackTexel(readTexel(&reference, textureIndex, level, x1, y1)), fractionX));
+	releaseTextureTile(&reference);
+	return addTuples(scaleTuple(top, 1.f - fractionY), scaleTuple(bottom, fractionY));
+}
+
+// -----------------------------------------------
+// @denpa: Samples an image texture with a filter that covers the footprint, given in texture coordinates.
+// When the footprint is smaller than a texel the full size image is filtered bilinearly,
+// otherwise the two mip levels around the footprint are filtered trilinearly.
+// -----------------------------------------------
+INTERNAL DNOINLINE colour sampleImageTexture(u32 textureIndex, f32 u, f32 v, f32 footprint) {
+	texture* texture = &textures.textures[textureIndex];
+	f32 level = log2f(DENPA_MAX(footprint * (f32)DENPA_MAX(texture->width, texture->height), 1.f));
+	level = DENPA_MIN(level, (f32)(texture->levelCount - 1));
+	u32 lowerLevel = (u32)level;
+	f32 fraction = level - (f32)lowerLevel;
+
+	colour result = sampleTextureLevel(textureIndex, lowerLevel, u, v);
+	if (fraction > 0.f && lowerLevel + 1 < texture->levelCount) {
+		colour upper = sampleTextureLevel(textureIndex, lowerLevel + 1, u, v);
+		result = addTuples(scaleTuple(result, 1.f - fraction), scaleTuple(upper, fraction));
+	}
+	return result;
+}
+
+// -----------------------------------------------
+// @denpa: A square wave that is 1 on [0, 1) and -1 on [1, 2), box filtered over the given width.
+// The integral of the square wave is a triangle wave, so the filtered value is the slope of the triangle wave across the filter.
+// -----------------------------------------------
+INTERNAL DINLINE f32 filteredSquareWave(f32 x, f32 width) {
+	f32 start = (x - (width * .5f)) * .5f;
+	f32 end = (x + (width * .5f)) * .5f;
+	return 2.f * (fabsf(start - floorf(start) - .5f) - fabsf(end - floorf(end) - .5f)) / width;
+}
+
+// -----------------------------------------------
+// @denpa: Samples the texture at the texture coordinates. The footprint is the size of the area covered by the ray,
+// in texture coordinates, and chooses how much the texture is filtered.
+// -----------------------------------------------
+INTERNAL DNOINLINE colour sampleTexture(u32 textureIndex, sample2D uv, f32 footprint) {
+	texture* texture = &textures.textures[textureIndex];
+	f32 u = uv.u * texture->scale;
+	f32 v = uv.v * texture->scale;
+	f32 width = (footprint * texture->scale) + TEXTURE_MINIMUM_FILTER_WIDTH;
+	f32 weightB = 0.f;
+	switch (texture->type) {
+		case TEXTURE_IMAGE: return sampleImageTexture(textureIndex, u - floorf(u), v - floorf(v), footprint * texture->scale);
+		case TEXTURE_CHECKER: weightB = .5f - (.5f * filteredSquareWave(u, width) * filteredSquareWave(v, width)); break;
+		case TEXTURE_STRIPES: weightB = .5f - (.5f * filteredSquareWave(u, width)); break;
+		case TEXTURE_GRADIENT: weightB = u - floorf(u); break;
+	}
+	return addTuples(scaleTuple(texture->colourA, 1.f - weightB), scaleTuple(texture->colourB, weightB));
+}
+
+// -----------------------------------------------
+// @denpa: Maps a point on a shape to texture coordinates, in object space.
+// Spheres, cylinders and cones wrap u around the y axis. Planes repeat the texture on every unit square,
+// and every face of a box holds the whole texture. The caps of cylinders and cones are mapped from above.
+// -----------------------------------------------
+INTERNAL DNOINLINE sample2D findShapeUV(world* world, worldHit hit, point worldPoint) {
+	f32 inverseTwoPi = 1.f / (2.f * (f32)PI32);
+	switch (hit.type) {
+		case SHAPE_SPHERE: {
+			sphere* sphere = &world->spheres[hit.index];
+			vector direction = subtractTuples(multiplyMatrix4x4Tuple(sphere->inverseTransformation, worldPoint), sphere->origin);
+			f32 y = DENPA_MAX(DENPA_MIN(direction.y / magnitudeOfTuple(direction), 1.f), -1.f);
+			return sample2D {.u = (atan2f(direction.x, direction.z) * inverseTwoPi) + .5f, .v = acosf(y) / (f32)PI32};
+		}
+		case SHAPE_PLANE: {
+			point objectPoint = multiplyMatrix4x4Tuple(world->planes[hit.index].inverseTransformation, worldPoint);
+			return sample2D {.u = objectPoint.x, .v = objectPoint.z};
+		}
+		case SHAPE_BOX: {
+			box* box = &world->boxes[hit.index];
+			point objectPoint = multiplyMatrix4x4Tuple(box->inverseTransformation, worldPoint);
+			f32 relative[3] = {};
+			u32 face = 0;
+			for (u32 axis = 0; axis < 3; axis++) {
+				relative[axis] = (objectPoint.v[axis] - box->minimum.v[axis]) / (box->maximum.v[axis] - box->minimum.v[axis]);
+				if (fabsf(relative[axis] - .5f) > fabsf(relative[face] - .5f)) {face = axis;}
+			}
+			return sample2D {.u = relative[(face + 1) % 3], .v = relative[(face + 2) % 3]};
+		}
+		case SHAPE_CYLINDER:
+		case SHAPE_CONE: {
+			bool isCylinder = hit.type == SHAPE_CYLINDER;
+			matrix4x4 inverseTransformation = isCylinder ? world->cylinders[hit.index].inverseTransformation : world->cones[hit.index].inverseTransformation;
+			f32 minimum = isCylinder ? world->cylinders[hit.index].minimum : world->cones[hit.index].minimum;
+			f32 maximum = isCylinder ? world->cylinders[hit.index].maximum : world->cones[hit.index].maximum;
+			point objectPoint = multiplyMatrix4x4Tuple(inverseTransformation, worldPoint);
+			f32 radius = isCylinder ? 1.f : DENPA_MAX(fabsf(objectPoint.y), EPSILON);
+			if (objectPoint.y >= maximum - EPSILON || objectPoint.y <= minimum + EPSILON) {
+				return sample2D {.u = (objectPoint.x / (2.f * radius)) + .5f, .v = (objectPoint.z / (2.f * radius)) + .5f};
+			}
+			f32 v = (minimum > -INFINITY && maximum < INFINITY) ? (maximum - objectPoint.y) / (maximum - minimum) : -objectPoint.y;
+			return sample2D {.u = (atan2f(objectPoint.x, objectPoint.z) * inverseTwoPi) + .5f, .v = v};
+		}
+		case SHAPE_TYPE_COUNT: break;
+	}
+	return sample2D {};
+}
+
+// -----------------------------------------------
+// @denpa: The distance between two texture coordinates, taking the shorter way around where the texture repeats.
+// -----------------------------------------------
+INTERNAL DINLINE f32 textureDistance(sample2D a, sample2D b) {
+	f32 u = a.u - b.u;
+	f32 v = a.v - b.v;
+	u -= roundf(u);
+	v -= roundf(v);
+	return sqrtf((u*u) + (v*v));
+}
+
+// -----------------------------------------------
+// @denpa: Finds the footprint of the ray on the surface in texture coordinates.
+// The ray spreads by pixelSpread per unit of distance, and the footprint on the surface is stretched along the ray
+// at grazing angles. The footprint is mapped to texture coordinates by mapping the points at its edges.
+// -----------------------------------------------
+INTERNAL DNOINLINE f32 findTextureFootprint(world* world, worldHit hit, point worldPoint, vector normal, vector rayDirection, f32 pixelSpread, sample2D uv) {
+	f32 width = hit.t * pixelSpread;
+	f32 cosine = dotProduct(normal, rayDirection);
+	vector along = subtractTuples(rayDirection, scaleTuple(normal, cosine));
+	if (magnitudeOfTuple(along) < EPSILON) {along = crossProduct(normal, (fabsf(normal.x) > .9f) ? createVector(0.f, 1.f, 0.f) : createVector(1.f, 0.f, 0.f));}
+	along = normalizeTuple(along);
+	vector across = crossProduct(normal, along);
+
+	f32 stretch = 1.f / DENPA_MAX(fabsf(cosine), TEXTURE_MINIMUM_COSINE);
+	sample2D alongUV = findShapeUV(world, hit, addTuples(worldPoint, scaleTuple(along, width * stretch)));
+	sample2D acrossUV = findShapeUV(world, hit, addTuples(worldPoint, scaleTuple(across, width)));
+	return DENPA_MAX(textureDistance(uv, alongUV), textureDistance(uv, acrossUV));
+}
+
+// -----------------------------------------------
+// @denpa: Returns the colour of the texture bound to the material at the hit, or white when no texture is bound.
+// -----------------------------------------------
+INTERNAL DINLINE colour findTextureColour(world* world, material* material, worldHit hit, point worldPoint, vector normal, vector rayDirection, f32 pixelSpread) {
+	if (material->texture == NO_TEXTURE) {return createColour(1.f, 1.f, 1.f, 1.f);}
+	sample2D uv = findShapeUV(world, hit, worldPoint);
+	f32 footprint = findTextureFootprint(world, hit, worldPoint, normal, rayDirection, pixelSpread, uv);
+	return sampleTexture(material->texture, uv, footprint);
+}
@@ -13,7 +13,7 @@ typedef struct intersection {
 	f32 t = 0.f;
 } intersection;
 
-#define MAX_INTERSECTION_COUNT 2
+#define MAX_INTERSECTION_COUNT 4
 
 // -----------------------------------------------
 // @denpa: A list of intersections
@@ -31,8 +31,11 @@ typedef struct ray {
 	vector rayDirection = createVector(0.f, 0.f, 0.f);
 } ray;
 
+#define NO_TEXTURE 0xFFFFFFFFu
+
 // -----------------------------------------------
 // @denpa: Material data
+// When a texture is bound, the surface colour is multiplied by the colour of the texture at the hit.
 // -----------------------------------------------
 typedef struct material {
 	colour surfaceColour = createColour(0.f, 0.f, 0.f, 0.f);
@@ -40,6 +43,7 @@ typedef struct material {
 	f32 diffuse = 0.f;
 	f32 specular = 0.f;
 	f32 shininess = 0.f;
+	u32 texture = NO_TEXTURE;
 } material;
 
 // -----------------------------------------------
@@ -56,6 +60,7 @@ typedef struct sphere {
 	point origin = createPoint(0.f, 0.f, 0.f);
 	f32 radius = 1.f;
 	matrix4x4 transformation = identityMatrix4x4();
+	matrix4x4 inverseTransformation = identityMatrix4x4();
 	material material = createMaterial();
 } sphere;
 
@@ -66,9 +71,56 @@ INTERNAL DNOINLINE sphere createSphere(void) {
 	return (sphere) {.origin = {{0.f, 0.f, 0.f, 1.f}},
 					.radius = 1.f,
 					.transformation = identityMatrix4x4(),
+					.inverseTransformation = identityMatrix4x4(),
 					.material = createMaterial()};
 }
 
+// -----------------------------------------------
+// @denpa: Plane data. In object space the plane is y = 0, the transformation places it in the world.
+// -----------------------------------------------
+typedef struct plane {
+	matrix4x4 transformation = identityMatrix4x4();
+	matrix4x4 inverseTransformation = identityMatrix4x4();
+	material material = createMaterial();
+} plane;
+
+// -----------------------------------------------
+// @denpa: Box data. In object space the box is aligned with the axes and spans from minimum to maximum.
+// -----------------------------------------------
+typedef struct box {
+	point minimum = createPoint(-1.f, -1.f, -1.f);
+	point maximum = createPoint(1.f, 1.f, 1.f);
+	matrix4x4 transformation = identityMatrix4x4();
+	matrix4x4 inverseTransformation = identityMatrix4x4();
+	material material = createMaterial();
+} box;
+
+// -----------------------------------------------
+// @denpa: Cylinder data. In object space the cylinder has a radius of 1 around the y axis and is cut off at minimum and maximum y.
+// The caps are only there when it is closed.
+// -----------------------------------------------
+typedef struct cylinder {
+	f32 minimum = -INFINITY;
+	f32 maximum = INFINITY;
+	bool closed = false;
+	matrix4x4 transformation = identityMatrix4x4();
+	matrix4x4 inverseTransformation = identityMatrix4x4();
+	material material = createMaterial();
+} cylinder;
+
+// -----------------------------------------------
+// @denpa: Cone data. In object space the cone is a double cone around the y axis, x^2 + z^2 = y^2, with the tips meeting at the origin.
+// It is cut off at minimum and maximum y like the cylinder, and the caps are only there when it is closed.
+// -----------------------------------------------
+typedef struct cone {
+	f32 minimum = -INFINITY;
+	f32 maximum = INFINITY;
+	bool closed = false;
+	matrix4x4 transformation = identityMatrix4x4();
+	matrix4x4 inverseTransformation = identityMatrix4x4();
+	material material = createMaterial();
+} cone;
+
 // -----------------------------------------------
 // @denpa: Defines a point light for the scene.
 // -----------------------------------------------
@@ -77,6 +129,117 @@ typedef struct pointLight {
 	point position = createPoint(0.f, 0.f, 0.f);
 } pointLight;
 
+// -----------------------------------------------
+// @denpa: The shapes an area light can take.
+// -----------------------------------------------
+typedef enum areaLightType : u32 {
+	AREA_LIGHT_SPHERE = 0,
+	AREA_LIGHT_RECTANGLE = 1,
+} areaLightType;
+
+// -----------------------------------------------
+// @denpa: Defines an area light for the scene.
+// For a sphere light, position is the centre and radius is used.
+// For a rectangle light, position is one corner and the two edges span the rectangle.
+// The intensity is that of a point light, whatever the size or shape of the light, see shadeAreaLights().
+// -----------------------------------------------
+typedef struct areaLight {
+	colour intensity = createColour(0.f, 0.f, 0.f, 0.f);
+	point position = createPoint(0.f, 0.f, 0.f);
+	vector edgeU = createVector(0.f, 0.f, 0.f);
+	vector edgeV = createVector(0.f, 0.f, 0.f);
+	f32 radius = 0.f;
+	areaLightType type = AREA_LIGHT_SPHERE;
+} areaLight;
+
+// -----------------------------------------------
+// @denpa: Creates a spherical area light.
+// -----------------------------------------------
+INTERNAL DNOINLINE areaLight createSphereLight(colour intensity, point centre, f32 radius) {
+	return (areaLight) {.intensity = intensity, .position = centre, .radius = radius, .type = AREA_LIGHT_SPHERE};
+}
+
+// -----------------------------------------------
+// @denpa: Creates a rectangular area light from one corner and its two edges.
+// -----------------------------------------------
+INTERNAL DNOINLINE areaLight createRectangleLight(colour intensity, point corner, vector edgeU, vector edgeV) {
+	return (areaLight) {.intensity = intensity, .position = corner, .edgeU = edgeU, .edgeV = edgeV, .type = AREA_LIGHT_RECTANGLE};
+}
+
+// -----------------------------------------------
+// @denpa: Everything in the scene.
+// The shape sets are the copies of the shapes the kernels work on, see createShapeSets().
+// They are dirty until createShapeSets() has run, and again as soon as the geometry of a shape changes,
+// in which case every shape is intersected one by one until the sets are rebuilt.
+// Materials are always read from the shapes themselves, so changing them never makes the sets dirty.
+// -----------------------------------------------
+typedef struct world {
+	sphere* spheres = NULL;
+	plane* planes = NULL;
+	box* boxes = NULL;
+	cylinder* cylinders = NULL;
+	cone* cones = NULL;
+	u64 sphereCount = 0;
+	u64 planeCount = 0;
+	u64 boxCount = 0;
+	u64 cylinderCount = 0;
+	u64 coneCount = 0;
+	shapeSet shapeSets[SHAPE_TYPE_COUNT] = {};
+	bool shapeSetsDirty = true;
+	areaLight* lights = NULL;
+	u64 lightCount = 0;
+} world;
+
+// -----------------------------------------------
+// @denpa: Marks the shape sets as out of date. Anything that changes the geometry of a shape, or adds one, has to call this.
+// -----------------------------------------------
+INTERNAL DINLINE void markShapesChanged(world* world) {
+	world->shapeSetsDirty = true;
+}
+
+// -----------------------------------------------
+// @denpa: Sets the transformation of the sphere.
+// The inverse is cached here so that it doesn't have to be recalculated for every single ray.
+// -----------------------------------------------
+INTERNAL DINLINE void setSphereTransformation(world* world, sphere* sphere, matrix4x4 transformation) {
+	sphere->transformation = transformation;
+	sphere->inverseTransformation = inverseMatrix4x4(transformation);
+	markShapesChanged(world);
+}
+
+// -----------------------------------------------
+// @denpa: Sets the transformation of the plane, box, cylinder or cone and caches the inverse, like setSphereTransformation().
+// -----------------------------------------------
+template <typename shape>
+INTERNAL DINLINE void setShapeTransformation(world* world, shape* object, matrix4x4 transformation) {
+	object->transformation = transformation;
+	object->inverseTransformation = inverseMatrix4x4(transformation);
+	markShapesChanged(world);
+}
+
+// -----------------------------------------------
+// @denpa: The closest hit in the world, found by type so that no pointer has to be kept per hit.
+// -----------------------------------------------
+typedef struct worldHit {
+	u64 index = SHAPE_SET_MISS;
+	shapeType type = SHAPE_SPHERE;
+	f32 t = 0.f;
+} worldHit;
+
+// -----------------------------------------------
+// @denpa: Controls how far the shadow ray origin is pushed off the surface to avoid self-shadowing (shadow acne).
+// -----------------------------------------------
+#define SHADOW_BIAS 0.0005f
+
+// -----------------------------------------------
+// @denpa: How much work goes into shading a hit. Without shadows the light samples are never tested for occlusion,
+// which saves every shadow ray at the cost of light leaking through the shapes.
+// -----------------------------------------------
+typedef enum shadingQuality : u32 {
+	SHADING_FULL = 0,
+	SHADING_NO_SHADOWS = 1,
+} shadingQuality;
+
 // -----------------------------------------------
 // @denpa: Finds the position of the ray given its origin and direction.
 // -----------------------------------------------
@@ -96,7 +259,7 @@ INTERNAL DINLINE ray transformRay(ray r, matrix4x4 transform) {
 // -----------------------------------------------
 INTERNAL DINLINE listOfIntersections findSphereRayIntersections(sphere* sphere, ray ray) {
 	listOfIntersections result {};
-	ray = transformRay(ray, inverseMatrix4x4(sphere->transformation));
+	ray = transformRay(ray, sphere->inverseTransformation);
 	tuple sphereToRay = subtractTuples(ray.rayOrigin, sphere->origin);
 	f32 a = dotProduct(ray.rayDirection, ray.rayDirection);
 	f32 b = 2.f * dotProduct(ray.rayDirection, sphereToRay);
@@ -119,6 +282,121 @@ INTERNAL DINLINE listOfIntersections findSphereRayIntersections(sphere* sphere,
 	return result;
 }
 
+// -----------------------------------------------
+// @denpa: Adds an intersection to the list, keeping the list sorted in ascending order.
+// -----------------------------------------------
+INTERNAL DINLINE void addIntersection(listOfIntersections* list, void* object, f32 t) {
+	if (list->intersectionCount >= MAX_INTERSECTION_COUNT) {return;}
+	u64 i = list->intersectionCount++;
+	for (; i > 0 && list->intersections[i - 1].t > t; i--) {list->intersections[i] = list->intersections[i - 1];}
+	list->intersections[i] = (intersection) {.object = object, .t = t};
+}
+
+// -----------------------------------------------
+// @denpa: Finds the point at which the plane and the ray intersects at. A ray parallel to the plane never hits it.
+// -----------------------------------------------
+INTERNAL DINLINE listOfIntersections findPlaneRayIntersections(plane* plane, ray ray) {
+	listOfIntersections result {};
+	ray = transformRay(ray, plane->inverseTransformation);
+	if (fabsf(ray.rayDirection.y) < EPSILON) {return result;}
+	addIntersection(&result, plane, -ray.rayOrigin.y / ray.rayDirection.y);
+	return result;
+}
+
+// -----------------------------------------------
+// @denpa: Finds the points at which the box and the ray intersects at, using the slab method.
+// Every pair of faces gives an interval of t values, and the ray is inside the box where all three overlap.
+// -----------------------------------------------
+INTERNAL DINLINE listOfIntersections findBoxRayIntersections(box* box, ray ray) {
+	listOfIntersections result {};
+	ray = transformRay(ray, box->inverseTransformation);
+	f32 nearT = -INFINITY;
+	f32 farT = INFINITY;
+	for (u32 axis = 0; axis < 3; axis++) {
+		f32 inverseDirection = 1.f / ray.rayDirection.v[axis];
+		f32 t0 = (box->minimum.v[axis] - ray.rayOrigin.v[axis]) * inverseDirection;
+		f32 t1 = (box->maximum.v[axis] - ray.rayOrigin.v[axis]) * inverseDirection;
+		nearT = DENPA_MAX(nearT, DENPA_MIN(t0, t1));
+		farT = DENPA_MIN(farT, DENPA_MAX(t0, t1));
+	}
+	if (nearT > farT) {return result;}
+	addIntersection(&result, box, nearT);
+	addIntersection(&result, box, farT);
+	return result;
+}
+
+// -----------------------------------------------
+// @denpa: Checks if the ray hits the cap at t, where the cap has the given squared radius.
+// -----------------------------------------------
+INTERNAL DINLINE bool isWithinCap(ray ray, f32 t, f32 radiusSquared) {
+	f32 x = ray.rayOrigin.x + (t * ray.rayDirection.x);
+	f32 z = ray.rayOrigin.z + (t * ray.rayDirection.z);
+	return ((x*x) + (z*z)) <= radiusSquared;
+}
+
+// -----------------------------------------------
+// @denpa: Adds the hits of a quadratic side of a cylinder or cone whose y value lies between minimum and maximum.
+// -----------------------------------------------
+INTERNAL DINLINE void addSideIntersections(listOfIntersections* list, void* object, ray ray, f32 a, f32 b, f32 c, f32 minimum, f32 maximum) {
+	f32 discriminant = (b*b) - (4 * a * c);
+	if (discriminant < 0.f) {return;}
+	f32 roots[2] = {(-b - sqrtf(discriminant)) / (2*a), (-b + sqrtf(discriminant)) / (2*a)};
+	for (u32 i = 0; i < 2; i++) {
+		f32 y = ray.rayOrigin.y + (roots[i] * ray.rayDirection.y);
+		if (minimum < y && y < maximum) {addIntersection(list, object, roots[i]);}
+	}
+}
+
+// -----------------------------------------------
+// @denpa: Finds the points at which the cylinder and the ray intersects at.
+// A ray parallel to the y axis can only hit the caps.
+// -----------------------------------------------
+INTERNAL DINLINE listOfIntersections findCylinderRayIntersections(cylinder* cylinder, ray ray) {
+	listOfIntersections result {};
+	ray = transformRay(ray, cylinder->inverseTransformation);
+	f32 a = (ray.rayDirection.x*ray.rayDirection.x) + (ray.rayDirection.z*ray.rayDirection.z);
+	if (!areFloatsEqual(a, 0.f)) {
+		f32 b = 2.f * ((ray.rayOrigin.x*ray.rayDirection.x) + (ray.rayOrigin.z*ray.rayDirection.z));
+		f32 c = (ray.rayOrigin.x*ray.rayOrigin.x) + (ray.rayOrigin.z*ray.rayOrigin.z) - 1.f;
+		addSideIntersections(&result, cylinder, ray, a, b, c, cylinder->minimum, cylinder->maximum);
+	}
+	if (cylinder->closed && fabsf(ray.rayDirection.y) >= EPSILON) {
+		f32 capT[2] = {(cylinder->minimum - ray.rayOrigin.y) / ray.rayDirection.y, (cylinder->maximum - ray.rayOrigin.y) / ray.rayDirection.y};
+		for (u32 i = 0; i < 2; i++) {
+			if (isWithinCap(ray, capT[i], 1.f)) {addIntersection(&result, cylinder, capT[i]);}
+		}
+	}
+	return result;
+}
+
+// -----------------------------------------------
+// @denpa: Finds the points at which the cone and the ray intersects at.
+// The radius of the cone at a cap is the y value of the cap.
+// -----------------------------------------------
+INTERNAL DINLINE listOfIntersections findConeRayIntersections(cone* cone, ray ray) {
+	listOfIntersections result {};
+	ray = transformRay(ray, cone->inverseTransformation);
+	f32 a = (ray.rayDirection.x*ray.rayDirection.x) - (ray.rayDirection.y*ray.rayDirection.y) + (ray.rayDirection.z*ray.rayDirection.z);
+	f32 b = 2.f * ((ray.rayOrigin.x*ray.rayDirection.x) - (ray.rayOrigin.y*ray.rayDirection.y) + (ray.rayOrigin.z*ray.rayDirection.z));
+	f32 c = (ray.rayOrigin.x*ray.rayOrigin.x) - (ray.rayOrigin.y*ray.rayOrigin.y) + (ray.rayOrigin.z*ray.rayOrigin.z);
+	if (!areFloatsEqual(a, 0.f)) {
+		addSideIntersections(&result, cone, ray, a, b, c, cone->minimum, cone->maximum);
+	} else if (!areFloatsEqual(b, 0.f)) {
+		// @denpa: The ray is parallel to one half of the cone, so it only hits the other half once.
+		f32 t = -c / (2.f * b);
+		f32 y = ray.rayOrigin.y + (t * ray.rayDirection.y);
+		if (cone->minimum < y && y < cone->maximum) {addIntersection(&result, cone, t);}
+	}
+	if (cone->closed && fabsf(ray.rayDirection.y) >= EPSILON) {
+		f32 capY[2] = {cone->minimum, cone->maximum};
+		for (u32 i = 0; i < 2; i++) {
+			f32 t = (capY[i] - ray.rayOrigin.y) / ray.rayDirection.y;
+			if (isWithinCap(ray, t, capY[i]*capY[i])) {addIntersection(&result, cone, t);}
+		}
+	}
+	return result;
+}
+
 // -----------------------------------------------
 // @denpa: Goes through the list of intersections and finds the intersection with the lowest positive t value.
 // It is assumed that the list of intersections is sorted in ascending order.
@@ -133,15 +411,74 @@ INTERNAL DINLINE struct intersection findRayHits(listOfIntersections list) {
 	return (intersection) {.object = NULL, .t = 0.f};
 }
 
+// -----------------------------------------------
+// @denpa: Moves a normal from object space into world space with the transpose of the inverse transformation.
+// -----------------------------------------------
+INTERNAL DINLINE vector objectToWorldNormal(matrix4x4 inverseTransformation, vector objectNormal) {
+	vector worldNormal = multiplyMatrix4x4Tuple(transposeMatrix4x4(inverseTransformation), objectNormal);
+	worldNormal.w = 0.f;
+	return normalizeTuple(worldNormal);
+}
+
 // -----------------------------------------------
 // @denpa: The normal on the sphere is calculated.
 // -----------------------------------------------
 INTERNAL DINLINE vector findNormalAt(sphere* sphere, point worldPoint) {
-	point objectPoint = multiplyMatrix4x4Tuple(inverseMatrix4x4(sphere->transformation), worldPoint);
+	point objectPoint = multiplyMatrix4x4Tuple(sphere->inverseTransformation, worldPoint);
 	vector objectNormal = subtractTuples(objectPoint, sphere->origin);
-	vector worldNormal = multiplyMatrix4x4Tuple(transposeMatrix4x4(inverseMatrix4x4(sphere->transformation)), objectNormal);
-	worldNormal.w = 0.f;
-	return normalizeTuple(worldNormal);
+	return objectToWorldNormal(sphere->inverseTransformation, objectNormal);
+}
+
+// -----------------------------------------------
+// @denpa: The normal on the plane is calculated, it is the same everywhere.
+// -----------------------------------------------
+INTERNAL DINLINE vector findPlaneNormalAt(plane* plane) {
+	return objectToWorldNormal(plane->inverseTransformation, createVector(0.f, 1.f, 0.f));
+}
+
+// -----------------------------------------------
+// @denpa: The normal on the box is calculated. It points out of the face the point is closest to,
+// which is the axis along which the point is the furthest from the centre relative to the size of the box.
+// -----------------------------------------------
+INTERNAL DINLINE vector findBoxNormalAt(box* box, point worldPoint) {
+	point objectPoint = multiplyMatrix4x4Tuple(box->inverseTransformation, worldPoint);
+	vector objectNormal = createVector(0.f, 0.f, 0.f);
+	f32 furthest = -1.f;
+	for (u32 axis = 0; axis < 3; axis++) {
+		f32 centre = (box->minimum.v[axis] + box->maximum.v[axis]) * .5f;
+		f32 offset = (objectPoint.v[axis] - centre) / ((box->maximum.v[axis] - box->minimum.v[axis]) * .5f);
+		if (fabsf(offset) > furthest) {
+			furthest = fabsf(offset);
+			objectNormal = createVector(0.f, 0.f, 0.f);
+			objectNormal.v[axis] = (offset < 0.f) ? -1.f : 1.f;
+		}
+	}
+	return objectToWorldNormal(box->inverseTransformation, objectNormal);
+}
+
+// -----------------------------------------------
+// @denpa: The normal on the cylinder is calculated, the caps point straight up or down.
+// -----------------------------------------------
+INTERNAL DINLINE vector findCylinderNormalAt(cylinder* cylinder, point worldPoint) {
+	point objectPoint = multiplyMatrix4x4Tuple(cylinder->inverseTransformation, worldPoint);
+	f32 distance = (objectPoint.x*objectPoint.x) + (objectPoint.z*objectPoint.z);
+	vector objectNormal = createVector(objectPoint.x, 0.f, objectPoint.z);
+	if (distance < 1.f && objectPoint.y >= cylinder->maximum - EPSILON) {objectNormal = createVector(0.f, 1.f, 0.f);}
+	else if (distance < 1.f && objectPoint.y <= cylinder->minimum + EPSILON) {objectNormal = createVector(0.f, -1.f, 0.f);}
+	return objectToWorldNormal(cylinder->inverseTransformation, objectNormal);
+}
+
+// -----------------------------------------------
+// @denpa: The normal on the cone is calculated, the caps point straight up or down.
+// -----------------------------------------------
+INTERNAL DINLINE vector findConeNormalAt(cone* cone, point worldPoint) {
+	point objectPoint = multiplyMatrix4x4Tuple(cone->inverseTransformation, worldPoint);
+	f32 distance = (objectPoint.x*objectPoint.x) + (objectPoint.z*objectPoint.z);
+	f32 y = sqrtf(distance);
+	vector objectNormal = createVector(objectPoint.x, (objectPoint.y > 0.f) ? -y : y, objectPoint.z);
+	if (distance < (cone->maximum*cone->maximum) && objectPoint.y >= cone->maximum - EPSILON) {objectNormal = createVector(0.f, 1.f, 0.f);}
+	else if (distance < (cone->minimum*cone->minimum) && objectPoint.y <= cone->minimum + EPSILON) {objectNormal = createVector(0.f, -1.f, 0.f);}
+	return objectToWorldNormal(cone->inverseTransformation, objectNormal);
 }
 
 // -----------------------------------------------
@@ -180,3 +517,161 @@ INTERNAL DINLINE colour phongLighting(material material, pointLight pointLight,
 	}
 	return addTuples(addTuples(ambient, diffuse), specular);
 }
+
+// -----------------------------------------------
+// @denpa: Returns the number of shapes of the given type in the world.
+// -----------------------------------------------
+INTERNAL DINLINE u64 getShapeCount(world* world, shapeType type) {
+	switch (type) {
+		case SHAPE_SPHERE: return world->sphereCount;
+		case SHAPE_PLANE: return world->planeCount;
+		case SHAPE_BOX: return world->boxCount;
+		case SHAPE_CYLINDER: return world->cylinderCount;
+		case SHAPE_CONE: return world->coneCount;
+		case SHAPE_TYPE_COUNT: break;
+	}
+	return 0;
+}
+
+// -----------------------------------------------
+// @denpa: Intersects the ray with one shape using the scalar reference functions.
+// -----------------------------------------------
+INTERNAL DINLINE listOfIntersections findShapeRayIntersections(world* world, shapeType type, u64 index, ray ray) {
+	switch (type) {
+		case SHAPE_SPHERE: return findSphereRayIntersections(&world->spheres[index], ray);
+		case SHAPE_PLANE: return findPlaneRayIntersections(&world->planes[index], ray);
+		case SHAPE_BOX: return findBoxRayIntersections(&world->boxes[index], ray);
+		case SHAPE_CYLINDER: return findCylinderRayIntersections(&world->cylinders[index], ray);
+		case SHAPE_CONE: return findConeRayIntersections(&world->cones[index], ray);
+		case SHAPE_TYPE_COUNT: break;
+	}
+	return listOfIntersections {};
+}
+
+// -----------------------------------------------
+// @denpa: Finds the normal of the shape that was hit.
+// -----------------------------------------------
+INTERNAL DINLINE vector findShapeNormalAt(world* world, worldHit hit, point worldPoint) {
+	switch (hit.type) {
+		case SHAPE_SPHERE: return findNormalAt(&world->spheres[hit.index], worldPoint);
+		case SHAPE_PLANE: return findPlaneNormalAt(&world->planes[hit.index]);
+		case SHAPE_BOX: return findBoxNormalAt(&world->boxes[hit.index], worldPoint);
+		case SHAPE_CYLINDER: return findCylinderNormalAt(&world->cylinders[hit.index], worldPoint);
+		case SHAPE_CONE: return findConeNormalAt(&world->cones[hit.index], worldPoint);
+		case SHAPE_TYPE_COUNT: break;
+	}
+	return createVector(0.f, 0.f, 0.f);
+}
+
+// -----------------------------------------------
+// @denpa: Returns the material of the shape that was hit.
+// -----------------------------------------------
+INTERNAL DINLINE material* getShapeMaterial(world* world, worldHit hit) {
+	switch (hit.type) {
+		case SHAPE_SPHERE: return &world->spheres[hit.index].material;
+		case SHAPE_PLANE: return &world->planes[hit.index].material;
+		case SHAPE_BOX: return &world->boxes[hit.index].material;
+		case SHAPE_CYLINDER: return &world->cylinders[hit.index].material;
+		case SHAPE_CONE: return &world->cones[hit.index].material;
+		case SHAPE_TYPE_COUNT: break;
+	}
+	return NULL;
+}
+
+// -----------------------------------------------
+// @denpa: Finds the closest hit below maximumT among the shapes of one type.
+// The SIMD kernels are used when the shape set is up to date, otherwise every shape is intersected one by one.
+// -----------------------------------------------
+INTERNAL DINLINE u64 findClosestShape(world* world, shapeType type, ray ray, f32 maximumT, f32* tOut) {
+	u64 count = getShapeCount(world, type);
+	if (!world->shapeSetsDirty) {
+		return kernels.findClosestShape[type](&world->shapeSets[type], ray.rayOrigin, ray.rayDirection, maximumT, tOut);
+	}
+
+	u64 closest = SHAPE_SET_MISS;
+	for (u64 i = 0; i < count; i++) {
+		intersection hit = findRayHits(findShapeRayIntersections(world, type, i, ray));
+		if (hit.object != NULL && hit.t < maximumT) {
+			closest = i;
+			maximumT = hit.t;
+		}
+	}
+	if (closest != SHAPE_SET_MISS) {*tOut = maximumT;}
+	return closest;
+}
+
+// -----------------------------------------------
+// @denpa: Goes through every type of shape in the world and finds the closest intersection with a positive t value.
+// Every type is intersected in one batch, and the closest hit so far lets the later batches skip the shapes behind it.
+// -----------------------------------------------
+INTERNAL DINLINE worldHit findWorldHit(world* world, ray ray) {
+	worldHit closest = {};
+	f32 closestT = INFINITY;
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		u64 index = findClosestShape(world, (shapeType)type, ray, closestT, &closestT);
+		if (index != SHAPE_SET_MISS) {closest = (worldHit) {.index = index, .type = (shapeType)type, .t = closestT};}
+	}
+	return closest;
+}
+
+// -----------------------------------------------
+// @denpa: Checks if anything in the world lies between the point and the light sample.
+// -----------------------------------------------
+INTERNAL DINLINE bool isShadowed(world* world, point overPoint, point lightPoint) {
+	vector toLight = subtractTuples(lightPoint, overPoint);
+	f32 distance = magnitudeOfTuple(toLight);
+	ray shadowRay = {overPoint, scaleTuple(toLight, 1.f / distance)};
+	for (u32 type = 0; type < SHAPE_TYPE_COUNT; type++) {
+		if (!world->shapeSetsDirty) {
+			if (kernels.isAnyShapeHit[type](&world->shapeSets[type], shadowRay.rayOrigin, shadowRay.rayDirection, distance)) {return true;}
+		} else {
+			f32 t = 0.f;
+			if (findClosestShape(world, (shapeType)type, shadowRay, distance, &t) != SHAPE_SET_MISS) {return true;}
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------
+// @denpa: Picks a point on the area light using the provided sample.
+// For sphere lights, the sample is placed uniformly on the disk facing the point being shaded, which is the silhouette
+// of the sphere as seen from that point. This avoids wasting samples on the back of the light.
+// No pdf comes with the point, since the samples are only used to find how much of the light is visible.
+// -----------------------------------------------
+INTERNAL DINLINE point sampleAreaLight(areaLight* light, point shadedPoint, sample2D s) {
+	if (light->type == AREA_LIGHT_RECTANGLE) {
+		return addTuples(light->position, addTuples(scaleTuple(light->edgeU, s.u), scaleTuple(light->edgeV, s.v)));
+	}
+
+	vector w = normalizeTuple(subtractTuples(shadedPoint, light->position));
+	vector helper = (fabsf(w.x) > .9f) ? createVector(0.f, 1.f, 0.f) : createVector(1.f, 0.f, 0.f);
+	vector u = normalizeTuple(crossProduct(helper, w));
+	vector v = crossProduct(w, u);
+	sample2D disk = mapSampleToDisk(s);
+	return addTuples(light->position, addTuples(scaleTuple(u, disk.u * light->radius), scaleTuple(v, disk.v * light->radius)));
+}
+
+// -----------------------------------------------
+// @denpa: Shades the point with one sample taken from every area light in the world.
+// Each sample is treated as a point light, and only the ambient term is kept when the sample is occluded.
+// Averaging many of these per pixel is what produces the soft shadows.
+// This is a soft shadow approximation and not a Monte Carlo estimate of the light reaching the point: the samples aren't
+// weighted by their pdf or solid angle, so a light looks as bright from far away as from close up, just like a point light,
+// and the average converges to the Phong lighting of the light samples times the fraction of the light that is visible.
+// -----------------------------------------------
+INTERNAL DINLINE colour shadeAreaLights(world* world, material material, point point, vector eyeVector, vector normalVector,
+										u32 pixelIndex, u32 sampleIndex, u32 seed, shadingQuality shading) {
+	colour result = createColour(0.f, 0.f, 0.f, 0.f);
+	tuple overPoint = addTuples(point, scaleTuple(normalVector, SHADOW_BIAS));
+	for (u64 i = 0; i < world->lightCount; i++) {
+		areaLight* light = &world->lights[i];
+		sample2D s = lowDiscrepancySample2D(pixelIndex, sampleIndex, SAMPLE_DIMENSION_LIGHT + ((u32)i * 2), seed);
+		pointLight lightSample = {.intensity = light->intensity, .position = sampleAreaLight(light, point, s)};
+		if (shading == SHADING_FULL && isShadowed(world, overPoint, lightSample.position)) {
+			result = addTuples(result, scaleTuple(multiplyTuples(material.surfaceColour, light->intensity), material.ambient));
+		} else {
+			result = addTuples(result, phongLighting(material, lightSample, point, eyeVector, normalVector));
+		}
+	}
+	return result;
+}
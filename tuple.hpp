@@ -20,6 +20,7 @@ typedef union tuple {
 		f32 z;
 		f32 w;
 	};
+	f32 v[4]; // Used to index the components by axis.
 } tuple;
 
 typedef tuple colour;
@@ -130,10 +131,10 @@ INTERNAL DINLINE vector crossProduct(vector a, vector b) {
 INTERNAL DNOINLINE void clampAndScaleColours(colour* pixels, u64 canvasX, u64 canvasY) {
 	for (u64 y = 0; y < canvasY; y++) {
 		for (u64 x = 0; x < canvasX; x++) {
-			pixels[y * canvasY + x].r = DENPA_CLAMP(pixels[y*canvasY+x].r, 0.f, 1.f);
-			pixels[y * canvasY + x].g = DENPA_CLAMP(pixels[y*canvasY+x].g, 0.f, 1.f);
-			pixels[y * canvasY + x].b = DENPA_CLAMP(pixels[y*canvasY+x].b, 0.f, 1.f);
-			pixels[y * canvasY + x] = scaleTuple(pixels[y*canvasY+x], 255.f);
+			pixels[y * canvasX + x].r = DENPA_CLAMP(pixels[y*canvasX+x].r, 0.f, 1.f);
+			pixels[y * canvasX + x].g = DENPA_CLAMP(pixels[y*canvasX+x].g, 0.f, 1.f);
+			pixels[y * canvasX + x].b = DENPA_CLAMP(pixels[y*canvasX+x].b, 0.f, 1.f);
+			pixels[y * canvasX + x] = scaleTuple(pixels[y*canvasX+x], 255.f);
 		}
 	}
 }